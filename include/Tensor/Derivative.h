@@ -1,38 +1,153 @@
+#pragma once
+
 #include "Tensor/Vector.h"
+#include "Tensor/Grid.h"
+#include "Tensor/GridGhost.h"
+#include "Tensor/Parallel.h"
 #include "Common/Macros.h"
+#include "Common/Sequence.h"	//seq_get_v
 #include <functional>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <limits>
 
 namespace Tensor {
 
 /*
-partial derivative index operator
-(partial derivative alone one coordinate)
+finite-difference stencils, generated at compile time by Fornberg's algorithm
+B. Fornberg, "Generation of Finite Difference Formulas on Arbitrarily Spaced Grids", Math. Comp. 51 (1988)
 
-finite difference coefficients for center-space finite-difference partial derivatives found at
-http://en.wikipedia.org/wiki/Finite_difference_coefficients
+fornbergWeights<derivative, numPoints>(first) gives the weights of the samples at offsets first ... first+numPoints-1
+for the derivative'th derivative at 0, in units of the sample spacing.
+A stencil of n points is accurate to order n - derivative.
+Centered stencils gain one order only when n - derivative is odd, i.e. their order is n - derivative rounded up to even:
+3 points are order 2 for both the first and second derivative.
+
+FiniteDifferenceStencil<Real, derivative, numPoints, first> holds them as constexpr Reals, with
+	apply(f) = sum of weights[s] * f(first + s), unrolled and skipping zero weights.
+CenteredStencil<Real, derivative, accuracy> is centered on 0.
+ForwardStencil / BackwardStencil<Real, derivative, accuracy> are one-sided, for boundaries and upwinding.
+Any other first gives a biased stencil.
+Mixed derivatives d/dx^i d/dx^j are the product of a stencil along i and one along j.
 */
 
-template<typename Real, int order>
-struct PartialDerivativeCoeffs;
+template<int derivative, int numPoints>
+requires (derivative >= 0 && numPoints > derivative)
+constexpr std::array<long double, numPoints> fornbergWeights(int first) {
+	// c[m][j] = weight of sample j for the m'th derivative, built up one sample at a time
+	std::array<std::array<long double, numPoints>, derivative + 1> c = {};
+	auto x = [first](int j) -> long double { return first + j; };
+	long double c1 = 1;
+	long double c4 = x(0);
+	c[0][0] = 1;
+	for (int i = 1; i < numPoints; ++i) {
+		int const mn = std::min(i, derivative);
+		long double c2 = 1;
+		long double const c5 = c4;
+		c4 = x(i);
+		for (int j = 0; j < i; ++j) {
+			long double const c3 = x(i) - x(j);
+			c2 *= c3;
+			if (j == i - 1) {
+				for (int k = mn; k >= 1; --k) {
+					c[k][i] = c1 * (k * c[k-1][i-1] - c5 * c[k][i-1]) / c2;
+				}
+				c[0][i] = -c1 * c5 * c[0][i-1] / c2;
+			}
+			for (int k = mn; k >= 1; --k) {
+				c[k][j] = (c4 * c[k][j] - k * c[k-1][j]) / c3;
+			}
+			c[0][j] = c4 * c[0][j] / c3;
+		}
+		c1 = c2;
+	}
+	return c[derivative];
+}
 
-template<typename Real>
-struct PartialDerivativeCoeffs<Real, 2> {
-	static constexpr std::array<Real, 1> coeffs = { 1./2. };
-};
+template<typename Real, int derivative_, int numPoints_, int first_>
+struct FiniteDifferenceStencil {
+	static constexpr int derivative = derivative_;
+	static constexpr int numPoints = numPoints_;
+	static constexpr int first = first_;
+	static constexpr int last = first + numPoints - 1;
 
-template<typename Real>
-struct PartialDerivativeCoeffs<Real, 4> {
-	static constexpr std::array<Real, 2> coeffs = { 2./3., -1./12. };
-};
+	static constexpr std::array<Real, numPoints> weights = []() {
+		auto const w = fornbergWeights<derivative, numPoints>(first);
+		std::array<Real, numPoints> result = {};
+		for (int s = 0; s < numPoints; ++s) result[s] = (Real)w[s];
+		return result;
+	}();
+
+	// centered stencils are symmetric or antisymmetric, so apply() can pair up samples
+	static constexpr bool isCentered = first == -last;
+	static constexpr int parity = derivative % 2 ? -1 : 1;
+
+	// the samples apply() reads: all nonzero weights, or for centered stencils the nonzero weights at offsets >= 0
+	static constexpr int numTerms = []() {
+		int n = 0;
+		for (int s = isCentered ? -first : 0; s < numPoints; ++s) n += weights[s] != 0;
+		return n;
+	}();
+	static constexpr std::array<int, numTerms> terms = []() {
+		std::array<int, numTerms> result = {};
+		int n = 0;
+		for (int s = isCentered ? -first : 0; s < numPoints; ++s) {
+			if (weights[s] != 0) result[n++] = s;
+		}
+		return result;
+	}();
 
-template<typename Real>
-struct PartialDerivativeCoeffs<Real, 6> {
-	static constexpr std::array<Real, 3> coeffs = { 3./4., -3./20., 1./60. };
+	// sum of weights[s] * f(first + s), in units of the sample spacing
+	template<typename F>
+	static constexpr auto apply(F && f) {
+		return [&]<int... t>(std::integer_sequence<int, t...>) {
+			return (term<terms[t]>(f) + ...);
+		}(std::make_integer_sequence<int, numTerms>{});
+	}
+
+protected:
+	template<int s, typename F>
+	static constexpr auto term(F && f) {
+		constexpr int offset = first + s;
+		if constexpr (!isCentered || offset == 0) {
+			return f(offset) * weights[s];
+		} else if constexpr (parity < 0) {
+			return (f(offset) - f(-offset)) * weights[s];
+		} else {
+			return (f(offset) + f(-offset)) * weights[s];
+		}
+	}
 };
 
-template<typename Real>
-struct PartialDerivativeCoeffs<Real, 8> {
-	static constexpr std::array<Real, 4> coeffs = { 4./5., -1./5., 4./105., -1./280. };
+template<typename Real, int derivative, int accuracy>
+requires (accuracy > 0 && accuracy % 2 == 0)
+using CenteredStencil = FiniteDifferenceStencil<Real, derivative, 2 * ((derivative + 1) / 2) - 1 + accuracy, 1 - (derivative + 1) / 2 - accuracy / 2>;
+
+template<typename Real, int derivative, int accuracy>
+requires (accuracy > 0)
+using ForwardStencil = FiniteDifferenceStencil<Real, derivative, derivative + accuracy, 0>;
+
+template<typename Real, int derivative, int accuracy>
+requires (accuracy > 0)
+using BackwardStencil = FiniteDifferenceStencil<Real, derivative, derivative + accuracy, 1 - derivative - accuracy>;
+
+/*
+partial derivative index operator
+(partial derivative alone one coordinate)
+
+coeffs[i] is the weight of f(x+i+1), and minus the weight of f(x-i-1), of the centered first derivative of accuracy 'order'
+same as the table at http://en.wikipedia.org/wiki/Finite_difference_coefficients
+*/
+
+template<typename Real, int order>
+struct PartialDerivativeCoeffs {
+	using Stencil = CenteredStencil<Real, 1, order>;
+	static constexpr std::array<Real, order / 2> coeffs = []() {
+		std::array<Real, order / 2> result = {};
+		for (int i = 0; i < order / 2; ++i) result[i] = Stencil::weights[order / 2 + 1 + i];
+		return result;
+	}();
 };
 
 // continuous derivative
@@ -70,6 +185,304 @@ auto partialDerivative(
 	return result;
 }
 
+/*
+batched and parallel continuous derivatives
+
+For expensive f, the samples of a derivative can be evaluated together.
+A batched function takes a std::vector of points and returns a std::vector of their values.
+	batchOf(f) evaluates f at each point in turn.
+	parallelBatchOf(f, policy) evaluates f at the points concurrently on the thread pool.  f must be safe to call concurrently.
+	Or write one that hands the whole batch to a GPU, an interpolator, etc.
+
+partialDerivativeBatched<order>(fBatch, x, h) is partialDerivative with all order * dim samples in one batch.
+partialDerivative<order>(f, x, h, policy) does the same with parallelBatchOf(f, policy).
+*/
+
+template<typename F>
+auto batchOf(F && f) {
+	return [f = std::forward<F>(f)](auto const & xs) {
+		std::vector<std::remove_cvref_t<decltype(f(xs[0]))>> result;
+		result.reserve(xs.size());
+		for (auto const & x : xs) result.push_back(f(x));
+		return result;
+	};
+}
+
+// defaults to handing out one point at a time, for expensive f of uneven cost
+template<typename F>
+auto parallelBatchOf(F && f, ParallelPolicy policy = {ParallelPolicy::Dynamic, 1}) {
+	return [f = std::forward<F>(f), policy](auto const & xs) {
+		std::vector<std::remove_cvref_t<decltype(f(xs[0]))>> result(xs.size());
+		parallelForBlocks((int)xs.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) result[i] = f(xs[i]);
+		}, policy);
+		return result;
+	};
+}
+
+// the points x + s h e_k of partialDerivative, for each k, for s = 1, -1, 2, -2, ... order/2, -order/2
+template<int order, typename X>
+std::vector<X> partialDerivativePoints(X const & x, typename X::Scalar h) {
+	constexpr int dim = X::template dim<0>;
+	std::vector<X> xs;
+	xs.reserve(order * dim);
+	for (int k = 0; k < dim; ++k) {
+		for (int i = 1; i <= order / 2; ++i) {
+			for (int sign : {1, -1}) {
+				auto x2 = x;
+				x2[k] += h * (sign * i);
+				xs.push_back(x2);
+			}
+		}
+	}
+	return xs;
+}
+
+// partialDerivative from f at partialDerivativePoints
+template<int order, int dim, typename T, typename S>
+vec<T, dim> partialDerivativeFromSamples(std::vector<T> const & fs, S h) {
+	using C = PartialDerivativeCoeffs<S, order>;
+	constexpr int radius = order / 2;
+	vec<T, dim> result;
+	for (int k = 0; k < dim; ++k) {
+		T sum = {};
+		for (int i = 0; i < radius; ++i) {
+			sum += (fs[2 * (k * radius + i)] - fs[2 * (k * radius + i) + 1]) * C::coeffs[i];
+		}
+		result[k] = (T)(sum / h);
+	}
+	return result;
+}
+
+template<int order = 2>
+auto partialDerivativeBatched(
+	auto fBatch,
+	auto x,
+	typename decltype(x)::Scalar h = .01
+) {
+	using X = decltype(x);
+	return partialDerivativeFromSamples<order, X::template dim<0>>(fBatch(partialDerivativePoints<order>(x, h)), h);
+}
+
+template<int order = 2>
+auto partialDerivative(
+	auto f,
+	auto x,
+	typename decltype(x)::Scalar h,
+	ParallelPolicy const & policy
+) {
+	return partialDerivativeBatched<order>(parallelBatchOf(f, policy), x, h);
+}
+
+/*
+Richardson extrapolation of partialDerivative, Ridders' method:
+evaluates partialDerivative at steps h, h/2, h/4, ... up to maxLevels steps,
+and extrapolates them to step 0 with the tableau of Neville's algorithm.
+A centered stencil of order p has error terms h^p, h^(p+2), h^(p+4) ..., so each column of the tableau removes one.
+Stops once the error estimate is below tolerance, or stops improving.
+
+Halving the step puts every other sample on a sample of the previous step,
+so samples are cached and only the new ones are evaluated, in one batch per step.
+For order 2 nothing is shared, for order 4 half of each step's samples are, for order 8 three quarters.
+*/
+template<typename R, typename S>
+struct DerivativeEstimate {
+	R value;	// best extrapolated derivative
+	S error = {};	// estimate of its error, max over components
+	int numEvals = {};	// number of evaluations of f
+	int numLevels = {};	// number of steps used
+};
+
+template<int order = 2>
+auto partialDerivativeRichardson(
+	auto fBatch,
+	auto x,
+	typename decltype(x)::Scalar h,
+	typename decltype(x)::Scalar tolerance,
+	int maxLevels = 8
+) {
+	using X = decltype(x);
+	using S = typename X::Scalar;
+	using T = std::remove_cvref_t<decltype(fBatch(std::vector<X>{x})[0])>;
+	constexpr int dim = X::template dim<0>;
+	using R = vec<T, dim>;
+	if (maxLevels < 1 || maxLevels > 24) throw Common::Exception() << "maxLevels " << maxLevels << " must be in [1,24]";
+
+	/*
+	cache of f(x + units * h / 2^(maxLevels-1) e_k), by (k, units)
+	evaluates the samples of one step, only calling fBatch for those not already cached
+	*/
+	std::map<std::pair<int, int>, T> cache;
+	int numEvals = 0;
+	auto samples = [&](int level, S step) {
+		auto const xs = partialDerivativePoints<order>(x, step);
+		std::vector<std::pair<int, int>> keys;
+		std::vector<X> missing;
+		std::vector<std::pair<int, int>> missingKeys;
+		int n = 0;
+		for (int k = 0; k < dim; ++k) {
+			for (int i = 1; i <= order / 2; ++i) {
+				for (int sign : {1, -1}) {
+					auto const key = std::make_pair(k, sign * (i << (maxLevels - 1 - level)));
+					keys.push_back(key);
+					if (!cache.count(key)) {
+						cache.emplace(key, T{});
+						missing.push_back(xs[n]);
+						missingKeys.push_back(key);
+					}
+					++n;
+				}
+			}
+		}
+		if (!missing.empty()) {
+			auto const fs = fBatch(missing);
+			numEvals += (int)missing.size();
+			for (std::size_t j = 0; j < missing.size(); ++j) cache[missingKeys[j]] = fs[j];
+		}
+		std::vector<T> result;
+		result.reserve(keys.size());
+		for (auto const & key : keys) result.push_back(cache[key]);
+		return result;
+	};
+
+	auto maxAbs = [](R const & r) -> S {
+		S m = {};
+		for (auto const & c : r.write()) m = std::max<S>(m, std::abs((S)c));
+		return m;
+	};
+
+	auto result = DerivativeEstimate<R, S>{};
+	result.error = std::numeric_limits<S>::infinity();
+	// tableau, row per level
+	std::vector<std::vector<R>> a;
+	S step = h;
+	for (int level = 0; level < maxLevels; ++level, step /= 2) {
+		a.emplace_back();
+		a[level].push_back(partialDerivativeFromSamples<order, dim>(samples(level, step), step));
+		if (level == 0) {
+			result.value = a[0][0];
+			result.numLevels = 1;
+			continue;
+		}
+		S factor = 1;
+		for (int n = 0; n < order; ++n) factor *= 2;
+		for (int j = 1; j <= level; ++j, factor *= 4) {
+			a[level].push_back((R)((a[level][j-1] * factor - a[level-1][j-1]) / (factor - 1)));
+			S const err = std::max(maxAbs((R)(a[level][j] - a[level][j-1])), maxAbs((R)(a[level][j] - a[level-1][j-1])));
+			if (err <= result.error) {
+				result.error = err;
+				result.value = a[level][j];
+				result.numLevels = level + 1;
+			}
+		}
+		// higher order is getting worse, roundoff has taken over
+		if (maxAbs((R)(a[level][level] - a[level-1][level-1])) >= 2 * result.error) break;
+		if (result.error <= tolerance) break;
+	}
+	result.numEvals = numEvals;
+	return result;
+}
+
+/*
+d/dx^j d/dx^k f at x, as a sym<T, dim> for T = f(x)
+Each distinct sample point is evaluated once:
+	f(x) once for the whole diagonal,
+	each sample along an axis once, for its diagonal term,
+	each sample off the axes once, for the jk term, which kj shares by symmetry.
+That's 1 + order * dim + order^2 * dim * (dim - 1) / 2 calls of f, vs (order * dim)^2 for nesting partialDerivative.
+*/
+template<int order = 2>
+auto secondPartialDerivative(
+	auto f,
+	auto x,
+	typename decltype(x)::Scalar h = .01
+) {
+	using X = decltype(x);
+	using T = decltype(f(x));
+	using S = typename X::Scalar;
+	using D1 = CenteredStencil<S, 1, order>;
+	using D2 = CenteredStencil<S, 2, order>;
+	constexpr int dim = X::template dim<0>;
+	auto xofs = [&](int j, int a, int k, int b) {
+		auto x2 = x;
+		x2[j] += h * a;
+		x2[k] += h * b;
+		return x2;
+	};
+	T const fx = f(x);
+	sym<T, dim> result;
+	for (int j = 0; j < dim; ++j) {
+		result(j,j) = (T)(D2::apply([&](int a) -> T {
+			return a ? f(xofs(j, a, j, 0)) : fx;
+		}) / (h * h));
+		for (int k = j + 1; k < dim; ++k) {
+			result(j,k) = (T)(D1::apply([&](int a) {
+				return D1::apply([&](int b) -> T {
+					return f(xofs(j, a, k, b));
+				});
+			}) / (h * h));
+		}
+	}
+	return result;
+}
+
+/*
+covariant derivative
+covariantDerivative<valence...>(t, dt, conn)(k)(I) = nabla_k t(I)
+	t = tensor at a point, with valence 'u' or 'd' per index, same as valence<>()
+	dt = partial derivative of t, first index is derivative, i.e. from partialDerivative
+	conn(a)(b,c) = Christoffel symbol Gamma^a_bc, symmetric in its lower indexes, so stored as vec<sym>
+nabla_k t^i_j = d/dx^k t^i_j + Gamma^i_km t^m_j - Gamma^m_kj t^i_m, etc, with a connection term per index.
+Each stored component of the result is summed in place, without building connection products or other temporaries.
+For a scalar t this is dt.
+*/
+template<char... valence, typename T, typename S, int N>
+vec<T, N> covariantDerivative(
+	T const & t,
+	vec<T, N> const & dt,
+	vec<sym<S, N>, N> const & conn
+) {
+	if constexpr (!is_tensor_v<T>) {
+		static_assert(sizeof...(valence) == 0, "scalars have no valence");
+		return dt;
+	} else {
+		constexpr int rank = T::rank;
+		static_assert(sizeof...(valence) == rank, "give one valence per index of t");
+		static_assert(((valence == 'u' || valence == 'd') && ...), "valence must be 'u' or 'd'");
+		static_assert([]<int... p>(std::integer_sequence<int, p...>) {
+			return ((T::template dim<p> == N) && ...);
+		}(std::make_integer_sequence<int, rank>{}), "every index of t must have the connection's dimension");
+		using Scalar = typename T::Scalar;
+		using valseq = std::integer_sequence<char, valence...>;
+
+		vec<T, N> result;
+		auto w = result.write();
+		for (auto it = w.begin(); it != w.end(); ++it) {
+			auto const & ki = it.readIndex;
+			int const k = ki(0);
+			intN<rank> i([&](int j) -> int { return ki(j+1); });
+			Scalar sum = dt(k)(i);
+			// one connection term per index of t
+			auto term = [&]<int p>() {
+				auto j = i;
+				for (int m = 0; m < N; ++m) {
+					j(p) = m;
+					if constexpr (Common::seq_get_v<p, valseq> == 'u') {
+						sum += conn(i(p))(k, m) * t(j);
+					} else {
+						sum -= conn(m)(k, i(p)) * t(j);
+					}
+				}
+			};
+			[&]<int... p>(std::integer_sequence<int, p...>) {
+				(term.template operator()<p>(), ...);
+			}(std::make_integer_sequence<int, rank>{});
+			*it = sum;
+		}
+		return result;
+	}
+}
+
 // grid derivatives
 // TODO redo the whole Grid class
 
@@ -155,4 +568,342 @@ auto partialDerivativeGrid(
 	return PartialDerivativeGridImpl<order, Real, dim, InputType>::exec(index, dx, f);
 }
 
+
+/*
+whole-grid partial derivatives
+
+partialDerivative<order>(src, dx) returns a Grid of vec<T, rank>, whose i'th component is d/dx^i of src, first index is derivative, same as above.
+secondPartialDerivative<order>(src, dx) returns a Grid of sym<T, rank>, whose ij'th component is d/dx^i d/dx^j of src.
+Cells within order/2 of an edge use biased stencils, shifted to stay inside the grid, so no cell is left out.
+These are the same width for first derivatives, and one point wider for second derivatives, so the edges keep the order of the interior.
+The ghostGrid overloads read the ghost cells instead and use centered stencils everywhere.  Call fillGhosts() first.
+
+The grid is swept one row along the fastest index at a time, rows in parallel.
+Within a row every sample of the stencil is a fixed offset from the cell, so the loop is loads at constant offsets and multiplies by compile-time coefficients.
+*/
+
+/*
+stencils of numPoints points for the derivative'th derivative, shifted to keep their samples within [0,n):
+starting radius cells before x where they fit, biased near the edges, one-sided at them.
+With an odd numPoints and the default radius they are centered where they fit.
+*/
+template<typename Real, int derivative, int numPoints, int radius_ = numPoints / 2>
+requires (radius_ >= 0 && numPoints > 2 * radius_)
+struct ShiftedStencils {
+	static constexpr int radius = radius_;
+
+	// weights[j] is the stencil starting at offset -j
+	static constexpr auto weights = []() {
+		std::array<std::array<Real, numPoints>, numPoints> result = {};
+		for (int j = 0; j < numPoints; ++j) {
+			auto const w = fornbergWeights<derivative, numPoints>(-j);
+			for (int s = 0; s < numPoints; ++s) result[j][s] = (Real)w[s];
+		}
+		return result;
+	}();
+
+	// first offset of the stencil at x in [0,n)
+	static constexpr int first(int x, int n) {
+		return std::min(std::max(-radius, -x), n - numPoints - x);
+	}
+
+	// sum of the weights of the stencil at x in [0,n) times f(offset)
+	template<typename F>
+	static auto apply(int x, int n, F && f) {
+		int const start = first(x, n);
+		auto const & w = weights[-start];
+		auto sum = f(start) * w[0];
+		for (int s = 1; s < numPoints; ++s) {
+			sum += f(start + s) * w[s];
+		}
+		return sum;
+	}
+};
+
+// 1 / dx(k)^derivative
+template<int derivative, typename Real, int rank>
+vec<Real, rank> stencilScale(vec<Real, rank> const & dx) {
+	return vec<Real, rank>([&](int k) -> Real {
+		Real s = 1;
+		for (int n = 0; n < derivative; ++n) s /= dx(k);
+		return s;
+	});
+}
+
+// calls f(i) for every i in [0,size) within radius of an edge
+template<int rank, typename F>
+void parallelForGridEdges(intN<rank> const & size, int radius, F && f, ParallelPolicy const & policy = {}) {
+	int const rowLength = size(0);
+	parallelForRows(size, [&](intN<rank> i) {
+		bool rowOnEdge = false;
+		for (int j = 1; j < rank; ++j) {
+			rowOnEdge |= i(j) < radius || i(j) >= size(j) - radius;
+		}
+		for (; i(0) < rowLength; ++i(0)) {
+			// skip to the far edge
+			if (!rowOnEdge && i(0) == radius) i(0) = std::max(radius, rowLength - radius);
+			if (i(0) < rowLength) f((intN<rank> const &)i);
+		}
+	}, policy);
+}
+
+/*
+calls row(s, d, sStep0) for every row of dst, with s and d the first cells of the row in src and dst,
+and sStep0 the step along dimension 0 of src, a compile-time 1 when it can be.
+*/
+template<typename DstType, typename SrcType, int rank, typename F>
+void parallelForStencilRows(
+	GridView<DstType, rank> const & dst,
+	GridView<SrcType, rank> const & src,
+	F && row,
+	ParallelPolicy const & policy = {}
+) {
+	parallelForRows(dst.size, [&](intN<rank> const & i) {
+		if (src.step(0) == 1) {
+			row(src.v + i.dot(src.step), dst.v + i.dot(dst.step), std::integral_constant<int, 1>());
+		} else {
+			row(src.v + i.dot(src.step), dst.v + i.dot(dst.step), src.step(0));
+		}
+	}, policy);
+}
+
+/*
+dst(i)(k) = Stencil along dimension k of src at i, for every i of dst.
+src must be readable from Stencil::first to Stencil::last cells past dst's edges in every direction.
+*/
+template<typename Stencil, typename T, int rank, typename Real>
+void gridStencilKernel(
+	GridView<vec<T, rank>, rank> const & dst,
+	GridView<T const, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	auto const scale = stencilScale<Stencil::derivative>(dx);
+	int const rowLength = dst.size(0);
+	parallelForStencilRows(dst, src, [&](T const * s, vec<T, rank> * d, auto sStep0) {
+		for (int x = 0; x < rowLength; ++x) {
+			T const * const p = s + x * sStep0;
+			vec<T, rank> & out = d[x * dst.step(0)];
+			[&]<int... k>(std::integer_sequence<int, k...>) {
+				((out(k) = (T)(Stencil::apply([&](int offset) -> T const & {
+					return p[offset * (k == 0 ? (int)sStep0 : src.step(k))];
+				}) * scale(k))), ...);
+			}(std::make_integer_sequence<int, rank>{});
+		}
+	}, policy);
+}
+
+/*
+fills the cells of dst within Stencil's radius of an edge of src, same size as dst.
+Along each dimension, cells near an edge use the stencil of the same width shifted inside the grid, down to fully one-sided.
+*/
+template<typename Stencil, typename T, int rank, typename Real>
+requires (Stencil::isCentered)
+void gridStencilEdges(
+	GridView<vec<T, rank>, rank> const & dst,
+	GridView<T const, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	using Shifted = ShiftedStencils<Real, Stencil::derivative, Stencil::numPoints>;
+	auto const scale = stencilScale<Stencil::derivative>(dx);
+	parallelForGridEdges(src.size, Shifted::radius, [&](intN<rank> const & i) {
+		T const * const p = &src(i);
+		auto & out = dst(i);
+		for (int k = 0; k < rank; ++k) {
+			out(k) = (T)(Shifted::apply(i(k), src.size(k), [&](int offset) -> T const & {
+				return p[offset * src.step(k)];
+			}) * scale(k));
+		}
+	}, policy);
+}
+
+/*
+dst(i)(j,k) = d/dx^j d/dx^k of src at i, for every i of dst, with centered stencils.
+The diagonal uses the second derivative stencil, the rest the product of first derivative stencils along j and k.
+src must be readable radius cells past dst's edges in every direction, corners included.
+*/
+template<int order, typename T, int rank, typename Real>
+void gridSecondDerivativeKernel(
+	GridView<sym<T, rank>, rank> const & dst,
+	GridView<T const, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	using D1 = CenteredStencil<Real, 1, order>;
+	using D2 = CenteredStencil<Real, 2, order>;
+	auto const scale1 = stencilScale<1>(dx);
+	auto const scale2 = stencilScale<2>(dx);
+	int const rowLength = dst.size(0);
+	parallelForStencilRows(dst, src, [&](T const * s, sym<T, rank> * d, auto sStep0) {
+		auto step = [&](int k) -> int { return k == 0 ? (int)sStep0 : src.step(k); };
+		for (int x = 0; x < rowLength; ++x) {
+			T const * const p = s + x * sStep0;
+			sym<T, rank> & out = d[x * dst.step(0)];
+			auto component = [&]<int j, int k>() {
+				if constexpr (j == k) {
+					out(j,k) = (T)(D2::apply([&](int a) -> T const & {
+						return p[a * step(j)];
+					}) * scale2(j));
+				} else if constexpr (j < k) {
+					out(j,k) = (T)(D1::apply([&](int a) {
+						return D1::apply([&](int b) -> T const & {
+							return p[a * step(j) + b * step(k)];
+						});
+					}) * (scale1(j) * scale1(k)));
+				}
+			};
+			auto components = [&]<int j>() {
+				[&]<int... k>(std::integer_sequence<int, k...>) {
+					(component.template operator()<j, k>(), ...);
+				}(std::make_integer_sequence<int, rank>{});
+			};
+			[&]<int... j>(std::integer_sequence<int, j...>) {
+				(components.template operator()<j>(), ...);
+			}(std::make_integer_sequence<int, rank>{});
+		}
+	}, policy);
+}
+
+/*
+the edge cells for gridSecondDerivativeKernel, with shifted stencils.
+An off-center n-point stencil loses one order for the second derivative but not for the first,
+so the diagonal uses numPoints+1 points where the centered stencil doesn't fit.
+*/
+template<int order, typename T, int rank, typename Real>
+void gridSecondDerivativeEdges(
+	GridView<sym<T, rank>, rank> const & dst,
+	GridView<T const, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	using D2 = CenteredStencil<Real, 2, order>;
+	using S1 = ShiftedStencils<Real, 1, CenteredStencil<Real, 1, order>::numPoints>;
+	using S2 = ShiftedStencils<Real, 2, D2::numPoints + 1, D2::last>;
+	static_assert(S1::radius == S2::radius);
+	constexpr int radius = S1::radius;
+	auto const scale1 = stencilScale<1>(dx);
+	auto const scale2 = stencilScale<2>(dx);
+	parallelForGridEdges(src.size, radius, [&](intN<rank> const & i) {
+		T const * const p = &src(i);
+		auto & out = dst(i);
+		for (int j = 0; j < rank; ++j) {
+			auto sample = [&](int a) -> T const & {
+				return p[a * src.step(j)];
+			};
+			out(j,j) = (T)((i(j) >= radius && i(j) < src.size(j) - radius
+				? D2::apply(sample)
+				: S2::apply(i(j), src.size(j), sample)
+			) * scale2(j));
+			for (int k = j + 1; k < rank; ++k) {
+				out(j,k) = (T)(S1::apply(i(j), src.size(j), [&](int a) {
+					return S1::apply(i(k), src.size(k), [&](int b) -> T const & {
+						return p[a * src.step(j) + b * src.step(k)];
+					});
+				}) * (scale1(j) * scale1(k)));
+			}
+		}
+	}, policy);
+}
+
+template<int numPoints, int rank>
+void checkStencilFits(intN<rank> const & size) {
+	for (int k = 0; k < rank; ++k) {
+		if (size(k) < numPoints) {
+			throw Common::Exception() << "a " << numPoints << " point stencil needs at least that many cells, but size is " << size;
+		}
+	}
+}
+
+template<int order = 2, typename SrcType, int rank, typename Real, typename T = std::remove_const_t<SrcType>>
+Grid<vec<T, rank>, rank> partialDerivative(
+	GridView<SrcType, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	using Stencil = CenteredStencil<Real, 1, order>;
+	constexpr int radius = Stencil::last;
+	auto result = Grid<vec<T, rank>, rank>(src.size, GridNoInit());
+	if (!src.size.product()) return result;
+	checkStencilFits<Stencil::numPoints>(src.size);
+	gridStencilEdges<Stencil, T, rank, Real>(result.view(), src, dx, policy);
+	auto const inner = src.size - 2 * radius;
+	gridStencilKernel<Stencil, T, rank, Real>(
+		result.sub(intN<rank>(radius), inner),
+		GridView<T const, rank>(src).sub(intN<rank>(radius), inner),
+		dx,
+		policy
+	);
+	return result;
+}
+
+template<int order = 2, typename T, int rank, typename Allocator, typename Real>
+Grid<vec<T, rank>, rank> partialDerivative(
+	Grid<T, rank, Allocator> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	return partialDerivative<order>(src.view(), dx, policy);
+}
+
+template<int order = 2, typename T, int rank, typename Allocator, typename Real>
+Grid<vec<T, rank>, rank> partialDerivative(
+	GhostGrid<T, rank, Allocator> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	using Stencil = CenteredStencil<Real, 1, order>;
+	constexpr int radius = Stencil::last;
+	if (src.ghost < radius) throw Common::Exception() << "order " << order << " derivatives need " << radius << " ghost cells but the grid has " << src.ghost;
+	auto result = Grid<vec<T, rank>, rank>(src.size, GridNoInit());
+	gridStencilKernel<Stencil, T, rank, Real>(result.view(), src.interior(), dx, policy);
+	return result;
+}
+
+template<int order = 2, typename SrcType, int rank, typename Real, typename T = std::remove_const_t<SrcType>>
+Grid<sym<T, rank>, rank> secondPartialDerivative(
+	GridView<SrcType, rank> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	constexpr int numPoints = CenteredStencil<Real, 1, order>::numPoints;
+	static_assert(numPoints == CenteredStencil<Real, 2, order>::numPoints);
+	constexpr int radius = numPoints / 2;
+	auto result = Grid<sym<T, rank>, rank>(src.size, GridNoInit());
+	if (!src.size.product()) return result;
+	// the widened one-sided second derivative stencils
+	checkStencilFits<numPoints + 1>(src.size);
+	gridSecondDerivativeEdges<order, T, rank, Real>(result.view(), src, dx, policy);
+	auto const inner = src.size - 2 * radius;
+	gridSecondDerivativeKernel<order, T, rank, Real>(
+		result.sub(intN<rank>(radius), inner),
+		GridView<T const, rank>(src).sub(intN<rank>(radius), inner),
+		dx,
+		policy
+	);
+	return result;
+}
+
+template<int order = 2, typename T, int rank, typename Allocator, typename Real>
+Grid<sym<T, rank>, rank> secondPartialDerivative(
+	Grid<T, rank, Allocator> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	return secondPartialDerivative<order>(src.view(), dx, policy);
+}
+
+template<int order = 2, typename T, int rank, typename Allocator, typename Real>
+Grid<sym<T, rank>, rank> secondPartialDerivative(
+	GhostGrid<T, rank, Allocator> const & src,
+	vec<Real, rank> const & dx,
+	ParallelPolicy const & policy = {}
+) {
+	constexpr int radius = CenteredStencil<Real, 1, order>::last;
+	if (src.ghost < radius) throw Common::Exception() << "order " << order << " derivatives need " << radius << " ghost cells but the grid has " << src.ghost;
+	auto result = Grid<sym<T, rank>, rank>(src.size, GridNoInit());
+	gridSecondDerivativeKernel<order, T, rank, Real>(result.view(), src.interior(), dx, policy);
+	return result;
+}
+
 }
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "Tensor/Vector.h"
+#include "Tensor/Range.h"
+#include "Common/Exception.h"
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+
+/*
+runtime einsum, for when the index pattern isn't known until runtime, i.e. read from a config file.
+The operands and result are still static-sized tensors, only the index labels are runtime.
+
+einsum<R>("ij,jk->ik", a, b) returns the R with R(i,k) = sum_j a(i,j) * b(j,k)
+If the "->" is omitted then the result labels are the ones that appear once, in alphabetical order, like numpy.
+Repeated labels within one operand take its diagonal, i.e. einsum<double>("ii", a) is the trace.
+
+The spec is parsed once into an EinsumPlan, which is cached per spec string (and per operand and result types).
+To skip the cache lookup altogether, hold onto the plan: auto plan = einsumPlan<R, A, B>("ij,jk->ik"); plan(a, b);
+
+All operands are summed together in one loop nest, rather than contracted pairwise like TensorMulExpr does,
+so for chains of three or more operands index notation will do less work.
+*/
+
+namespace Tensor {
+
+template<int numOperands>
+struct EinsumPlanDetails {
+	using Strides = std::array<int, numOperands>;
+
+	// outer loops are the result labels, in result order, so the (dense) result is written in order.
+	std::vector<int> outerDims;
+	std::vector<Strides> outerStrides;
+	// inner loops are the summed labels, innermost has the smallest strides
+	std::vector<int> innerDims;
+	std::vector<Strides> innerStrides;
+	int outputCount = 1;
+	int innerCount = 1;
+
+	EinsumPlanDetails(
+		std::string_view spec,
+		std::array<std::vector<int>, numOperands> const & operandDims,
+		std::vector<int> const & resultDims
+	) {
+		// split the spec into its operand labels and result labels
+		std::string s;
+		for (char c : spec) {
+			if (c != ' ' && c != '\t') s += c;
+		}
+		auto const arrow = s.find("->");
+		bool const explicitResult = arrow != std::string::npos;
+		std::string const lhs = explicitResult ? s.substr(0, arrow) : s;
+		std::array<std::string, numOperands> operandLabels;
+		{
+			size_t start = 0;
+			for (int q = 0; q < numOperands; ++q) {
+				auto const comma = lhs.find(',', start);
+				if ((comma == std::string::npos) != (q == numOperands - 1)) {
+					throw Common::Exception() << "einsum spec " << spec << " expected " << numOperands << " operands";
+				}
+				operandLabels[q] = lhs.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+				start = comma + 1;
+			}
+		}
+
+		// gather label dims, in order of appearance
+		std::string labels;
+		std::vector<int> labelDims;
+		std::vector<int> labelCounts;
+		for (int q = 0; q < numOperands; ++q) {
+			if (operandLabels[q].size() != operandDims[q].size()) {
+				throw Common::Exception() << "einsum spec " << spec << " operand " << q << " has " << operandLabels[q].size() << " labels but rank " << operandDims[q].size();
+			}
+			for (size_t p = 0; p < operandLabels[q].size(); ++p) {
+				char const c = operandLabels[q][p];
+				if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+					throw Common::Exception() << "einsum spec " << spec << " has invalid label " << c;
+				}
+				auto const l = labels.find(c);
+				if (l == std::string::npos) {
+					labels += c;
+					labelDims.push_back(operandDims[q][p]);
+					labelCounts.push_back(1);
+				} else {
+					if (labelDims[l] != operandDims[q][p]) {
+						throw Common::Exception() << "einsum spec " << spec << " label " << c << " has dims " << labelDims[l] << " and " << operandDims[q][p];
+					}
+					++labelCounts[l];
+				}
+			}
+		}
+
+		std::string resultLabels;
+		if (explicitResult) {
+			resultLabels = s.substr(arrow + 2);
+		} else {
+			for (size_t l = 0; l < labels.size(); ++l) {
+				if (labelCounts[l] == 1) resultLabels += labels[l];
+			}
+			std::sort(resultLabels.begin(), resultLabels.end());
+		}
+		if (resultLabels.size() != resultDims.size()) {
+			throw Common::Exception() << "einsum spec " << spec << " has " << resultLabels.size() << " result labels but the result rank is " << resultDims.size();
+		}
+
+		// stride of a label in an operand is the sum of the row-major strides of each place the label appears
+		auto labelStrides = [&](char c) -> Strides {
+			Strides result = {};
+			for (int q = 0; q < numOperands; ++q) {
+				int stride = 1;
+				for (int p = (int)operandLabels[q].size() - 1; p >= 0; --p) {
+					if (operandLabels[q][p] == c) result[q] += stride;
+					stride *= operandDims[q][p];
+				}
+			}
+			return result;
+		};
+
+		for (size_t r = 0; r < resultLabels.size(); ++r) {
+			char const c = resultLabels[r];
+			auto const l = labels.find(c);
+			if (l == std::string::npos) {
+				throw Common::Exception() << "einsum spec " << spec << " result label " << c << " isn't in any operand";
+			}
+			if (resultLabels.find(c) != r) {
+				throw Common::Exception() << "einsum spec " << spec << " result label " << c << " is repeated";
+			}
+			if (labelDims[l] != resultDims[r]) {
+				throw Common::Exception() << "einsum spec " << spec << " result label " << c << " has dim " << labelDims[l] << " but the result has dim " << resultDims[r];
+			}
+			outerDims.push_back(labelDims[l]);
+			outerStrides.push_back(labelStrides(c));
+			outputCount *= labelDims[l];
+		}
+
+		std::vector<std::pair<int, char>> sums;	// {sum of strides, label}
+		for (size_t l = 0; l < labels.size(); ++l) {
+			char const c = labels[l];
+			if (resultLabels.find(c) != std::string::npos) continue;
+			auto const strides = labelStrides(c);
+			int strideSum = 0;
+			for (int q = 0; q < numOperands; ++q) strideSum += strides[q];
+			sums.emplace_back(strideSum, c);
+		}
+		std::sort(sums.begin(), sums.end(), [](auto const & a, auto const & b) { return a.first > b.first; });
+		for (auto const & [strideSum, c] : sums) {
+			int const dim = labelDims[labels.find(c)];
+			innerDims.push_back(dim);
+			innerStrides.push_back(labelStrides(c));
+			innerCount *= dim;
+		}
+	}
+
+	/*
+	src[q] is the row-major expanded elements of operand q
+	dst is the row-major expanded elements of the result
+	*/
+	template<typename Scalar>
+	void exec(std::array<Scalar const *, numOperands> const & src, Scalar * dst) const {
+		auto product = [&]<size_t ... q>(Strides const & offset, std::index_sequence<q...>) -> Scalar {
+			return (src[q][offset[q]] * ...);
+		};
+		int const numOuter = (int)outerDims.size();
+		int const numInner = (int)innerDims.size();
+		// innermost summed loop is run directly, the rest are counted with an odometer
+		int const lastDim = numInner ? innerDims[numInner-1] : 1;
+		Strides const lastStrides = numInner ? innerStrides[numInner-1] : Strides{};
+		int const numInnerOdometer = numInner ? numInner - 1 : 0;
+		std::vector<int> outerIndex(numOuter), innerIndex(numInnerOdometer);
+		Strides base = {};
+		for (int o = 0; o < outputCount; ++o) {
+			Scalar sum = {};
+			Strides offset = base;
+			for (;;) {
+				Strides k = offset;
+				for (int n = 0; n < lastDim; ++n) {
+					sum += product(k, std::make_index_sequence<numOperands>{});
+					for (int q = 0; q < numOperands; ++q) k[q] += lastStrides[q];
+				}
+				int l = numInnerOdometer - 1;
+				for (; l >= 0; --l) {
+					for (int q = 0; q < numOperands; ++q) offset[q] += innerStrides[l][q];
+					if (++innerIndex[l] < innerDims[l]) break;
+					for (int q = 0; q < numOperands; ++q) offset[q] -= innerStrides[l][q] * innerDims[l];
+					innerIndex[l] = 0;
+				}
+				if (l < 0) break;
+			}
+			dst[o] = sum;
+			for (int l = numOuter - 1; l >= 0; --l) {
+				for (int q = 0; q < numOperands; ++q) base[q] += outerStrides[l][q];
+				if (++outerIndex[l] < outerDims[l]) break;
+				for (int q = 0; q < numOperands; ++q) base[q] -= outerStrides[l][q] * outerDims[l];
+				outerIndex[l] = 0;
+			}
+		}
+	}
+};
+
+template<typename T>
+auto einsumDims() {
+	if constexpr (is_tensor_v<T>) {
+		auto const dims = T::dims();
+		std::vector<int> result(T::rank);
+		for (int i = 0; i < T::rank; ++i) result[i] = dims[i];
+		return result;
+	} else {
+		return std::vector<int>();
+	}
+}
+
+// row-major expanded elements of t
+template<typename Scalar, typename T>
+auto einsumFlatten(T const & t) {
+	std::array<Scalar, Common::seq_multiplies(typename T::dimseq())> result;
+	int n = 0;
+	for (auto i : RangeObj<T::rank, false>(typename T::intN(), T::dims())) {
+		result[n++] = (Scalar)t(i);
+	}
+	return result;
+}
+
+/*
+R is the result type, either a tensor or a scalar for full contractions
+Ts are the operand tensor types
+*/
+template<typename R, typename... Ts>
+requires (sizeof...(Ts) > 0 && (is_tensor_v<Ts> && ...))
+struct EinsumPlan {
+	static constexpr int numOperands = sizeof...(Ts);
+	using Scalar = typename decltype([]() {
+		if constexpr (is_tensor_v<R>) {
+			return std::type_identity<typename R::Scalar>();
+		} else {
+			return std::type_identity<R>();
+		}
+	}())::type;
+	EinsumPlanDetails<numOperands> details;
+
+	EinsumPlan(std::string_view spec)
+	: details(spec, {einsumDims<Ts>()...}, einsumDims<R>()) {}
+
+	R operator()(Ts const & ... ts) const {
+		auto const flats = std::make_tuple(einsumFlatten<Scalar>(ts)...);
+		std::array<Scalar const *, numOperands> const src = std::apply([](auto const & ... f) {
+			return std::array<Scalar const *, numOperands>{f.data()...};
+		}, flats);
+		if constexpr (is_tensor_v<R>) {
+			std::array<Scalar, Common::seq_multiplies(typename R::dimseq())> dst;
+			details.exec(src, dst.data());
+			// R may have sym etc storage, so read back by index
+			auto const stride = []() constexpr {
+				auto const dims = R::dims();
+				typename R::intN result;
+				int s = 1;
+				for (int i = R::rank - 1; i >= 0; --i) {
+					result[i] = s;
+					s *= dims[i];
+				}
+				return result;
+			}();
+			return R([&](typename R::intN i) -> Scalar {
+				return dst[i.dot(stride)];
+			});
+		} else {
+			R dst = {};
+			details.exec(src, &dst);
+			return dst;
+		}
+	}
+};
+
+template<typename R, typename... Ts>
+EinsumPlan<R, Ts...> einsumPlan(std::string_view spec) {
+	return EinsumPlan<R, Ts...>(spec);
+}
+
+// parses 'spec' upon first use, and caches its plan
+template<typename R, typename... Ts>
+R einsum(std::string_view spec, Ts const & ... ts) {
+	using Plan = EinsumPlan<R, Ts...>;
+	static std::unordered_map<std::string, Plan> plans;
+	static std::mutex plansMutex;
+	Plan const * plan = {};
+	{
+		std::lock_guard<std::mutex> lock(plansMutex);
+		auto i = plans.find(std::string(spec));
+		if (i == plans.end()) {
+			i = plans.emplace(std::string(spec), Plan(spec)).first;
+		}
+		// references to unordered_map elements stay valid after inserts
+		plan = &i->second;
+	}
+	return (*plan)(ts...);
+}
+
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "Tensor/Vector.h"
+#include "Tensor/Quat.h"
+#include "Tensor/QR.h"	//qrSolve
+#include <complex>
+#include <limits>
+#include <cmath>
+
+/*
+matrix exponential and logarithm
+
+exp(mat) uses scaling-and-squaring with a degree-7 Pade approximant, as in Higham 2005 "The Scaling and Squaring Method for the Matrix Exponential Revisited".
+log(mat) uses inverse scaling-and-squaring: Denman-Beavers square roots, then a Pade approximant of log(I+X) evaluated as a Gauss-Legendre sum.
+exp(asym3) and exp(asym4) are closed-form.
+*/
+
+namespace Tensor {
+
+// max column-sum norm
+template<typename T, int n>
+T norm1Impl(mat<T,n,n> const & a) {
+	T result = {};
+	for (int j = 0; j < n; ++j) {
+		T colSum = {};
+		for (int i = 0; i < n; ++i) {
+			colSum += std::abs(a(i,j));
+		}
+		result = std::max(result, colSum);
+	}
+	return result;
+}
+
+template<typename T, int n>
+mat<T,n,n> exp(mat<T,n,n> const & a) {
+	using M = mat<T,n,n>;
+	M const I = ident<T,n>(1);
+
+	// Higham's theta_7: largest 1-norm for which the [7/7] Pade approximant has double-precision backward error
+	constexpr T theta7 = (T)0.9504178996162932;
+	int s = 0;
+	T const anorm = norm1Impl(a);
+	if (anorm > theta7) {
+		s = (int)std::ceil(std::log2(anorm / theta7));
+	}
+	M const A = a / (T)std::ldexp(1., s);
+
+	// [7/7] Pade coefficients
+	constexpr T b[] = {17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1};
+	M const A2 = A * A;
+	M const A4 = A2 * A2;
+	M const A6 = A4 * A2;
+	M const U = A * (b[7] * A6 + b[5] * A4 + b[3] * A2 + b[1] * I);
+	M const V = b[6] * A6 + b[4] * A4 + b[2] * A2 + b[0] * I;
+	M result = qrSolve(M(V - U), M(V + U));
+
+	for (int i = 0; i < s; ++i) {
+		result = result * result;
+	}
+	return result;
+}
+
+/*
+principal matrix logarithm.
+'a' must not have eigenvalues on the closed negative real axis.
+*/
+template<typename T, int n>
+mat<T,n,n> log(mat<T,n,n> const & a) {
+	using M = mat<T,n,n>;
+	M const I = ident<T,n>(1);
+	T const epsilon = std::numeric_limits<T>::epsilon() * (T)(4 * n);
+
+	// take square roots until we are close enough to I for the Pade approximant
+	constexpr int maxRoots = 64;
+	constexpr int maxSqrtIters = 100;
+	M Y = a;
+	int k = 0;
+	for (; k < maxRoots && norm1Impl(M(Y - I)) > (T).25; ++k) {
+		// Denman-Beavers iteration: Y -> sqrt(Y), Z -> sqrt(Y)^-1
+		M Z = I;
+		for (int iter = 0; iter < maxSqrtIters; ++iter) {
+			M const Yinv = qrSolve(Y, I);
+			M const Zinv = qrSolve(Z, I);
+			M const Ynext = (Y + Zinv) * (T).5;
+			Z = (Z + Yinv) * (T).5;
+			T const delta = norm1Impl(M(Ynext - Y));
+			Y = Ynext;
+			if (delta <= epsilon * norm1Impl(Y)) break;
+		}
+	}
+
+	// log(I + X) ~= sum_j w_j X (I + x_j X)^-1 , x_j and w_j are Gauss-Legendre nodes and weights on [0,1]
+	// this is the [7/7] Pade approximant of log(1 + x)
+	constexpr T nodes[] = {
+		(T)-0.9491079123427585,
+		(T)-0.7415311855993945,
+		(T)-0.4058451513773972,
+		(T)0,
+		(T)0.4058451513773972,
+		(T)0.7415311855993945,
+		(T)0.9491079123427585,
+	};
+	constexpr T weights[] = {
+		(T)0.1294849661688697,
+		(T)0.2797053914892766,
+		(T)0.3818300505051189,
+		(T)0.4179591836734694,
+		(T)0.3818300505051189,
+		(T)0.2797053914892766,
+		(T)0.1294849661688697,
+	};
+	M const X = Y - I;
+	M result = {};
+	for (int j = 0; j < 7; ++j) {
+		T const x = (nodes[j] + 1) * (T).5;
+		T const w = weights[j] * (T).5;
+		// X and (I + x X) commute so the order of the solve doesn't matter
+		result += w * qrSolve(M(I + x * X), X);
+	}
+	return result * (T)std::ldexp(1., k);
+}
+
+/*
+Rodrigues' formula.
+'a' is the cross-product matrix of the axis-angle vector w = (a(2,1), a(0,2), a(1,0)) ,
+so exp(a) is the rotation of |w| radians around w.
+*/
+template<typename T>
+mat<T,3,3> exp(asym<T,3> const & a) {
+	vec<T,3> const w = {(T)a(2,1), (T)a(0,2), (T)a(1,0)};
+	T const thetaSq = w.lenSq();
+	T const theta = std::sqrt(thetaSq);
+	// sin(theta)/theta and (1 - cos(theta))/theta^2, by series near zero
+	T sinc, cosc;
+	if (thetaSq < (T)1e-6) {
+		sinc = 1 - thetaSq / 6;
+		cosc = (T).5 - thetaSq / 24;
+	} else {
+		sinc = std::sin(theta) / theta;
+		cosc = (1 - std::cos(theta)) / thetaSq;
+	}
+	// a^2 = w w^T - |w|^2 I
+	return mat<T,3,3>([&](int i, int j) -> T {
+		return (i == j ? 1 - cosc * thetaSq : 0)
+			+ sinc * (T)a(i,j)
+			+ cosc * w(i) * w(j);
+	});
+}
+
+// same as exp(asym3) but produces a unit quaternion
+template<typename T>
+quat<T> expQuat(asym<T,3> const & a) {
+	vec<T,3> const w = {(T)a(2,1), (T)a(0,2), (T)a(1,0)};
+	T const thetaSq = w.lenSq();
+	T const theta = std::sqrt(thetaSq);
+	// sin(theta/2)/theta
+	T const sinc = thetaSq < (T)1e-6
+		? (T).5 - thetaSq / 48
+		: std::sin(theta / 2) / theta;
+	return quat<T>(sinc * w(0), sinc * w(1), sinc * w(2), std::cos(theta / 2));
+}
+
+/*
+exp of a 4x4 matrix 'k' whose characteristic polynomial is even: x^4 + c x^2 + d.
+This holds for antisymmetric matrices and for Lorentz generators, i.e. eta^-1 times an antisymmetric matrix.
+By Cayley-Hamilton, exp(k) = a0 I + a1 k + a2 k^2 + a3 k^3.
+Eigenvalues come in pairs +-lambda, and with u = -lambda^2, u is a root of u^2 - c u + d,
+and a0 - a2 u = cos(sqrt(u)), a1 - a3 u = sin(sqrt(u)) / sqrt(u) for both roots.
+Those are solved with divided differences, in complex numbers for the loxodromic case.
+*/
+template<typename T>
+mat<T,4,4> expEven4Impl(mat<T,4,4> const & k) {
+	using M = mat<T,4,4>;
+	using C = std::complex<T>;
+	M const I = ident<T,4>(1);
+	M const k2 = k * k;
+	M const k3 = k2 * k;
+	T const c = -(k2(0,0) + k2(1,1) + k2(2,2) + k2(3,3)) / 2;
+	T const d = determinant(k);
+	C const disc = std::sqrt(C(c * c - 4 * d));
+	C const u1 = (c + disc) / (T)2;
+	C const u2 = (c - disc) / (T)2;
+
+	// cos(sqrt(u)) and sin(sqrt(u))/sqrt(u), and their derivatives wrt u, by series near zero
+	auto cosf = [](C u) -> C {
+		if (std::abs(u) < (T)1e-4) return (T)1 - u / (T)2 + u * u / (T)24;
+		return std::cos(std::sqrt(u));
+	};
+	auto sincf = [](C u) -> C {
+		if (std::abs(u) < (T)1e-4) return (T)1 - u / (T)6 + u * u / (T)120;
+		C const r = std::sqrt(u);
+		return std::sin(r) / r;
+	};
+	auto dcosf = [&](C u) -> C {
+		return -sincf(u) / (T)2;
+	};
+	auto dsincf = [&](C u) -> C {
+		if (std::abs(u) < (T)1e-4) return -(T)1 / (T)6 + u / (T)60 - u * u / (T)1680;
+		return (cosf(u) - sincf(u)) / ((T)2 * u);
+	};
+
+	/*
+	divided differences (f(u1) - f(u2)) / (u1 - u2).
+	The quotient loses epsilon / |u1 - u2| to cancellation, so below cbrt(epsilon) use the mean of f' over [u2, u1] instead,
+	by 2-point Gauss-Legendre: f'(um) + f'''(um) (u1 - u2)^2 / 24 + O((u1 - u2)^4).
+	*/
+	C dcos, dsinc;
+	C const du = u1 - u2;
+	if (std::abs(du) <= std::cbrt(std::numeric_limits<T>::epsilon()) * std::max((T)1, std::abs(u1))) {
+		C const um = (u1 + u2) / (T)2;
+		C const dg = du / ((T)2 * std::sqrt((T)3));
+		dcos = (dcosf(um - dg) + dcosf(um + dg)) / (T)2;
+		dsinc = (dsincf(um - dg) + dsincf(um + dg)) / (T)2;
+	} else {
+		dcos = (cosf(u1) - cosf(u2)) / du;
+		dsinc = (sincf(u1) - sincf(u2)) / du;
+	}
+	T const a2 = -std::real(dcos);
+	T const a3 = -std::real(dsinc);
+	T const a0 = std::real(cosf(u1) - dcos * u1);
+	T const a1 = std::real(sincf(u1) - dsinc * u1);
+	return a0 * I + a1 * k + a2 * k2 + a3 * k3;
+}
+
+// rotation in 4D
+template<typename T>
+mat<T,4,4> exp(asym<T,4> const & a) {
+	return expEven4Impl(mat<T,4,4>(a));
+}
+
+/*
+Lorentz transform generated by the antisymmetric 'w' with lowered indexes,
+i.e. exp(eta^-1 w) with eta = diag(-1,1,1,1).
+w(0,i) generates boosts and w(i,j) for i,j>0 generates rotations.
+*/
+template<typename T>
+mat<T,4,4> expLorentz(asym<T,4> const & w) {
+	return expEven4Impl(mat<T,4,4>([&](int i, int j) -> T {
+		return (i == 0 ? -1 : 1) * (T)w(i,j);
+	}));
+}
+
+// fall back on the general case
+template<typename T, int n>
+requires (n != 3 && n != 4)
+mat<T,n,n> exp(asym<T,n> const & a) {
+	return exp(mat<T,n,n>(a));
+}
+
+}
@@ -1,9 +1,15 @@
 #pragma once
 
+#include "Tensor/Grid.h.h"
 #include "Tensor/Vector.h"	// new tensor struct
 #include "Tensor/Range.h"
+#include "Tensor/GridAllocator.h"
 #include "Common/Exception.h"
 #include <cassert>
+#include <memory>		//shared_ptr
+#include <cstring>		//memcpy, memmove
+#include <type_traits>
+#include <algorithm>	//max
 
 #if PLATFORM_MSVC
 #undef min
@@ -23,23 +29,191 @@ inline intN<rank> stepForSize(intN<rank> const size) {
 	return step;
 }
 
+// tag for Grid ctors to skip zero-initialization of trivially-constructible Types
+struct GridNoInit {};
+
+/*
+non-owning view of a Grid's elements, or of any memory laid out with arbitrary per-dimension strides.
+Used for subregions, lower-rank slices, and every-n'th-element views, without copying.
+A view must not outlive the buffer it views.
+Type can be const for read-only views.
+*/
+template<typename Type_, int rank_>
+struct GridView {
+	using Type = Type_;
+	using value_type = Type;
+	static constexpr auto rank = rank_;
+	using intN = Tensor::intN<rank>;
+
+	Type * v = {};	// element at index 0
+	intN size;
+	intN step;	// in elements, for each dimension
+
+	GridView() {}
+
+	GridView(Type * v_, intN const & size_, intN const & step_)
+	: v(v_), size(size_), step(step_) {}
+
+	// non-const to const
+	template<typename SrcType>
+	requires (std::is_same_v<Type, SrcType const>)
+	GridView(GridView<SrcType, rank> const & src)
+	: v(src.v), size(src.size), step(src.step) {}
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Type & operator()(Ints... is) const {
+		return (*this)(intN((int)is...));
+	}
+
+	Type & operator()(intN const & deref) const {
+#ifdef DEBUG
+		for (int i = 0; i < rank; ++i) {
+			if (deref(i) < 0 || deref(i) >= size(i)) {
+				throw Common::Exception() << "size is " << size << " but dereference is " << deref;
+			}
+		}
+#endif
+		return v[deref.dot(step)];
+	}
+
+	RangeObj<rank> range() const {
+		return RangeObj<rank>(intN(), size);
+	}
+
+	// true if the elements are contiguous in the same order as Grid
+	bool isContiguous() const {
+		return step == stepForSize(size);
+	}
+
+	// the subregion [min, min+subsize)
+	GridView sub(intN const & min, intN const & subsize) const {
+		for (int i = 0; i < rank; ++i) {
+			if (min(i) < 0 || subsize(i) < 0 || min(i) + subsize(i) > size(i)) {
+				throw Common::Exception() << "subregion min " << min << " size " << subsize << " is out of bounds of size " << size;
+			}
+		}
+		return GridView(v + min.dot(step), subsize, step);
+	}
+
+	// every stride'th element, starting at 0
+	GridView strided(intN const & stride) const {
+		intN newSize, newStep;
+		for (int i = 0; i < rank; ++i) {
+			if (stride(i) < 1) throw Common::Exception() << "stride " << stride << " must be positive";
+			newSize(i) = (size(i) + stride(i) - 1) / stride(i);
+			newStep(i) = step(i) * stride(i);
+		}
+		return GridView(v, newSize, newStep);
+	}
+
+	// the rank-1 view with dimension 'dim' fixed at 'index'
+	template<int dim>
+	requires (rank > 1 && dim >= 0 && dim < rank)
+	GridView<Type, rank-1> slice(int index) const {
+		if (index < 0 || index >= size(dim)) {
+			throw Common::Exception() << "slice index " << index << " is out of bounds of size " << size(dim);
+		}
+		using intM = Tensor::intN<rank-1>;
+		return GridView<Type, rank-1>(
+			v + index * step(dim),
+			intM([&](int i) -> int { return size(i < dim ? i : i + 1); }),
+			intM([&](int i) -> int { return step(i < dim ? i : i + 1); })
+		);
+	}
+
+	template<typename Return>
+	decltype(auto) map(std::function<Return(std::remove_const_t<Type>)> f) const {
+		return Grid<Return, rank>(size, [&](intN i) -> Return {
+			return f((*this)(i));
+		});
+	}
+};
+
+// calls f(index) for the start of each row along dimension 0, in memory order
+template<int rank, typename F>
+void forEachGridRow(intN<rank> const & size, F && f) {
+	if (size.product() == 0) return;
+	auto rows = size;
+	rows(0) = 1;
+	for (auto i : RangeObj<rank>(intN<rank>(), rows)) {
+		f(i);
+	}
+}
+
+// f(i) for i in [min, min+extent), first index fastest
+template<int rank, typename F>
+void forEachIndexInBox(intN<rank> const & min, intN<rank> const & extent, F && f) {
+	if (!extent.product()) return;
+	auto i = min;
+	for (;;) {
+		for (int x = 0; x < extent(0); ++x) {
+			i(0) = min(0) + x;
+			f((intN<rank> const &)i);
+		}
+		int d = 1;
+		for (; d < rank; ++d) {
+			if (++i(d) < min(d) + extent(d)) break;
+			i(d) = min(d);
+		}
+		if (d == rank) return;
+	}
+}
+
+/*
+copy between equal-sized views.
+For trivially copyable Types this is one memcpy if both are contiguous, or one per row if both have unit step along dimension 0.
+The views must not overlap.
+*/
+template<typename DstType, typename SrcType, int rank>
+requires (std::is_same_v<DstType, std::remove_const_t<SrcType>>)
+void copyGridView(GridView<DstType, rank> const & dst, GridView<SrcType, rank> const & src) {
+	if (dst.size != src.size) throw Common::Exception() << "tried to copy size " << src.size << " into size " << dst.size;
+	if constexpr (std::is_trivially_copyable_v<DstType>) {
+		if (dst.isContiguous() && src.isContiguous()) {
+			std::memcpy(dst.v, src.v, sizeof(DstType) * dst.size.product());
+			return;
+		}
+		if (dst.step(0) == 1 && src.step(0) == 1) {
+			forEachGridRow(dst.size, [&](intN<rank> const & i) {
+				std::memcpy(&dst(i), &src(i), sizeof(DstType) * dst.size(0));
+			});
+			return;
+		}
+	}
+	for (auto i : dst.range()) {
+		dst(i) = src(i);
+	}
+}
+
 //rank is templated, but dim is not as it varies per-rank
 //so this is dynamically-sized tensor
-template<typename Type_, int rank_>
+/*
+Allocator is any std Allocator, by default 64-byte aligned.  See GridAllocator.h for huge-page and pooled allocators.
+Owned buffers are held in a shared_ptr, so share() can produce Grids that share the same buffer,
+and the buffer is freed when the last of them is destroyed.
+Grids constructed from an external pointer don't own it.
+*/
+template<typename Type_, int rank_, typename Allocator_>
 struct Grid {
 	using Type = Type_;
 	using value_type = Type;
 	static constexpr auto rank = rank_;
 	using intN = Tensor::intN<rank>;
+	using Allocator = Allocator_;
+	using AllocTraits = std::allocator_traits<Allocator>;
 
 	intN size;
 	Type * v = {};
-	bool own = {};	//or just use a shared_ptr to v?
+	std::shared_ptr<Type> buffer;	// empty if v is not owned
+	std::size_t capacity = {};	// elements in buffer, which can be more than size.product() after shrinking
 
 	//cached for quick access by dot with index vector
 	//step[0] = 1, step[1] = size[0], step[j] = product(i=1,j-1) size[i]
 	intN step;
 
+	[[no_unique_address]] Allocator alloc;
+
 	Grid() {
 		// TODO but in my ptr ctor I say v cannot be null ... ?
 	}
@@ -47,60 +221,131 @@ struct Grid {
 	// deep copy
 	Grid(Grid const & src)
 	:	size(src.size),
-		v(new Type[src.size.product()]()),
-		own(true),
-		step(stepForSize(src.size))
+		step(stepForSize(src.size)),
+		alloc(AllocTraits::select_on_container_copy_construction(src.alloc))
 	{
-		for (auto i : range()) {
-			(*this)(i) = src(i);
-		}
+		allocBuffer(false);
+		copyGridView(view(), src.view());
 	}
 
 	Grid(Grid && src)
 	:	size(src.size),
 		v(src.v),
-		own(true),
-		step(stepForSize(src.size))
+		buffer(std::move(src.buffer)),
+		capacity(src.capacity),
+		step(src.step),
+		alloc(std::move(src.alloc))
 	{
 		src.v = nullptr;
-		src.own = false;	// don't free
+		src.capacity = 0;
 	}
 
-	Grid(intN const & size_)
+	// zero-initialized
+	Grid(intN const & size_, Allocator const & alloc_ = {})
 	:	size(size_),
-		v(new Type[size.product()]()),
-		own(true),
-		step(stepForSize(size_))
-	{}
+		step(stepForSize(size_)),
+		alloc(alloc_)
+	{
+		allocBuffer(true);
+	}
+
+	// left uninitialized if Type is trivially constructible, otherwise default-constructed
+	Grid(intN const & size_, GridNoInit, Allocator const & alloc_ = {})
+	:	size(size_),
+		step(stepForSize(size_)),
+		alloc(alloc_)
+	{
+		allocBuffer(false);
+	}
 
 	// shallow copy by default ... when passed a pointer ...
 	// ... is this a bad idea?
 	Grid(intN const & size_, Type * v_)
 	:	size(size_),
 		v(v_),
-		own(false),
 		step(stepForSize(size_))
 	{
 		if (!v) throw Common::Exception() << "v cannot be null.  use the (intN) constructor.";
 	}
 
-	Grid(intN const & size_, std::function<Type(intN)> f)
+	// deep copy of a view, compacted
+	template<typename SrcType>
+	requires (std::is_same_v<std::remove_const_t<SrcType>, Type>)
+	explicit Grid(GridView<SrcType, rank> const & src, Allocator const & alloc_ = {})
+	:	size(src.size),
+		step(stepForSize(src.size)),
+		alloc(alloc_)
+	{
+		allocBuffer(false);
+		copyGridView(view(), src);
+	}
+
+	Grid(intN const & size_, std::function<Type(intN)> f, Allocator const & alloc_ = {})
 	:	size(size_),
-		v(new Type[size_.product()]()),
-		own(true),
-		step(stepForSize(size_))
+		step(stepForSize(size_)),
+		alloc(alloc_)
 	{
+		allocBuffer(false);	// every element is written next
 		for (auto i : range()) {
 			(*this)(i) = f(i);
 		}
 	}
 
-	~Grid() {
-		if (own) {
-			delete[] v;
-		}
+	// evaluates a GridExpr, see GridExpr.h
+	template<typename F, typename... Args>
+	Grid(GridExpr<F, Args...> const & e, Allocator const & alloc_ = {})
+	:	size(e.size),
+		step(stepForSize(e.size)),
+		alloc(alloc_)
+	{
+		allocBuffer(false);
+		gridAssign(view(), e);
+	}
+
+	// true if this Grid owns (or shares ownership of) its buffer
+	bool owns() const { return (bool)buffer; }
+
+	// views, see GridView
+	GridView<Type, rank> view() { return GridView<Type, rank>(v, size, step); }
+	GridView<Type const, rank> view() const { return GridView<Type const, rank>(v, size, step); }
+	operator GridView<Type, rank>() { return view(); }
+	operator GridView<Type const, rank>() const { return view(); }
+
+	GridView<Type, rank> sub(intN const & min, intN const & subsize) { return view().sub(min, subsize); }
+	GridView<Type const, rank> sub(intN const & min, intN const & subsize) const { return view().sub(min, subsize); }
+	GridView<Type, rank> strided(intN const & stride) { return view().strided(stride); }
+	GridView<Type const, rank> strided(intN const & stride) const { return view().strided(stride); }
+	template<int dim> GridView<Type, rank-1> slice(int index) { return view().template slice<dim>(index); }
+	template<int dim> GridView<Type const, rank-1> slice(int index) const { return view().template slice<dim>(index); }
+
+	// shallow copy that shares the buffer
+	Grid share() const {
+		Grid result;
+		result.size = size;
+		result.v = v;
+		result.buffer = buffer;
+		result.capacity = capacity;
+		result.step = step;
+		result.alloc = alloc;
+		return result;
+	}
+
+protected:
+	// allocate an owned buffer of size.product() elements into v
+	void allocBuffer(bool zeroInit) {
+		std::size_t const n = size.product();
+		buffer = allocGridBuffer(alloc, n, zeroInit);
+		v = buffer.get();
+		capacity = n;
+	}
+
+	// true if the buffer is ours alone and can hold n elements
+	bool canReuseBuffer(std::size_t n) const {
+		return buffer && buffer.use_count() == 1 && n <= capacity;
 	}
 
+public:
+
 	// dereference by vararg ints
 
 	template<int offset, typename... Rest>
@@ -187,64 +432,99 @@ struct Grid {
 
 	//dereference by a vector of ints
 
+	/*
+	resize, keeping the elements in the overlap of the old and new sizes.
+	new elements are uninitialized for trivially constructible Types.
+	shrinking a buffer that isn't shared is done in place, since the rows only move to lower addresses.
+	*/
 	void resize(intN const& newSize) {
 		if (size == newSize) return;
 
-		intN oldSize = size;
-		intN oldStep = step;
-		Type* oldV = v;
-
-		size = newSize;
-		v = new Type[newSize.product()];
-		step(0) = 1;
-		for (int i = 1; i < rank; ++i) {
-			step(i) = step(i-1) * size(i-1);
-		}
-
 		intN minSize;
+		bool shrinking = true;
 		for (int i = 0; i < rank; ++i) {
-			minSize(i) = size(i) < oldSize(i) ? size(i) : oldSize(i);
+			minSize(i) = newSize(i) < size(i) ? newSize(i) : size(i);
+			shrinking &= newSize(i) <= size(i);
 		}
 
-		RangeObj<rank> range(intN(), minSize);
-		for (typename RangeObj<rank>::iterator iter = range.begin(); iter != range.end(); ++iter) {
-			intN index = *iter;
-			int oldOffset = oldStep.dot(index);
-			(*this)(index) = oldV[oldOffset];
+		if constexpr (std::is_trivially_copyable_v<Type>) {
+			if (shrinking && canReuseBuffer(newSize.product())) {
+				intN const oldStep = step;
+				intN const newStep = stepForSize(newSize);
+				// rows move in increasing order, and each row's destination is no later than its source
+				forEachGridRow(minSize, [&](intN const & i) {
+					std::memmove(v + i.dot(newStep), v + i.dot(oldStep), sizeof(Type) * minSize(0));
+				});
+				size = newSize;
+				step = newStep;
+				return;
+			}
 		}
 
-		delete[] oldV;
+		auto const old = view();
+		auto oldBuffer = std::move(buffer);	// keep it alive until we're done copying
+
+		size = newSize;
+		step = stepForSize(size);
+		allocBuffer(false);
+		copyGridView(view().sub(intN(), minSize), GridView<Type const, rank>(old).sub(intN(), minSize));
+	}
+
+	/*
+	copy src into this, resizing to src's size.
+	reuses the current buffer if it isn't shared and has the capacity, otherwise allocates.
+	if the size matches, the copy is written in place, even if the buffer is shared or external.
+	*/
+	void copyFrom(GridView<Type const, rank> const & src) {
+		if (src.size != size) {
+			std::size_t const n = src.size.product();
+			// src is in our buffer: copy it out first
+			if (buffer && std::less_equal<Type const *>()(v, src.v) && std::less<Type const *>()(src.v, v + capacity)) {
+				*this = Grid(src, alloc);
+				return;
+			}
+			if (!canReuseBuffer(n)) {
+				buffer = {};
+				capacity = 0;
+				size = src.size;
+				allocBuffer(false);
+			}
+			size = src.size;
+			step = stepForSize(size);
+		}
+		if (src.v == v && src.step == step) return;
+		copyGridView(view(), src);
 	}
 
 	Grid & operator=(Grid const & src) {
-		resize(src.size);
+		if (this != &src) copyFrom(src.view());
+		return *this;
+	}
 
-		Type* srcv = src.v;
-		Type* dstv = v;
-		for (int i = size.product()-1; i >= 0; --i) {
-			*(dstv++) = *(srcv++);
-		}
+	template<typename F, typename... Args>
+	Grid & operator=(GridExpr<F, Args...> const & e) {
+		gridAssign(*this, e);
 		return *this;
 	}
 
 	Grid & operator=(Grid && src) {
-		if (own) {
-			delete[] v;
-		}
 		v = src.v;
-		own = src.own;
+		buffer = std::move(src.buffer);
+		capacity = src.capacity;
 		size = src.size;
 		step = src.step;
+		alloc = std::move(src.alloc);
 		src.v = nullptr;
-		src.own = false;
+		src.capacity = 0;
 		return *this;
 	}
 
 	template<typename Return>
 	decltype(auto) map(std::function<Return(Type)> f) const {
-		return Grid<Return, rank>(size, [&](intN i) -> Return {
+		using ReturnAllocator = typename AllocTraits::template rebind_alloc<Return>;
+		return Grid<Return, rank, ReturnAllocator>(size, [&](intN i) -> Return {
 			return f((*this)(i));
-		});
+		}, ReturnAllocator(alloc));
 	}
 };
 
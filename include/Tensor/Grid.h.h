@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>	//max
+
+namespace Tensor {
+
+template<typename T, std::size_t alignment>
+struct AlignedAllocator;
+
+template<
+	typename Type,
+	int rank,
+	typename Allocator = AlignedAllocator<Type, std::max<std::size_t>(64, alignof(Type))>
+>
+struct Grid;
+
+template<typename Type, int rank>
+struct GridView;
+
+template<typename F, typename... Args>
+struct GridExpr;
+
+}
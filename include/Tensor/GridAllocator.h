@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <memory>	//shared_ptr, uninitialized_value_construct_n
+#include <map>
+#include <vector>
+#include <mutex>
+#include <limits>
+
+#if defined(__linux__)
+#include <sys/mman.h>	//madvise
+#endif
+
+/*
+allocators for Grid buffers.
+These follow the std Allocator requirements, so std::allocator<Type> works as well.
+Grid does its own construction, so these only hand out memory.
+*/
+
+namespace Tensor {
+
+/*
+an owned buffer of n elements, for Grid, LayoutGrid and MappedGrid.
+The elements are value-initialized if zeroInit, otherwise default-initialized, so left uninitialized if trivial.
+They are destroyed and deallocated with a copy of alloc when the last shared_ptr to them goes.
+*/
+template<typename Allocator>
+std::shared_ptr<typename std::allocator_traits<Allocator>::value_type> allocGridBuffer(Allocator alloc, std::size_t n, bool zeroInit) {
+	using AllocTraits = std::allocator_traits<Allocator>;
+	using T = typename AllocTraits::value_type;
+	T * p = AllocTraits::allocate(alloc, n);
+	try {
+		if (zeroInit) {
+			std::uninitialized_value_construct_n(p, n);
+		} else {
+			std::uninitialized_default_construct_n(p, n);
+		}
+	} catch (...) {
+		AllocTraits::deallocate(alloc, p, n);
+		throw;
+	}
+	return std::shared_ptr<T>(p, [alloc, n](T * p) mutable {
+		std::destroy_n(p, n);
+		AllocTraits::deallocate(alloc, p, n);
+	});
+}
+
+// aligned to 'alignment' bytes, 64 by default for cache lines and AVX-512
+template<typename T, std::size_t alignment = 64>
+struct AlignedAllocator {
+	static_assert(alignment >= alignof(T) && !(alignment & (alignment - 1)), "alignment must be a power of two no less than alignof(T)");
+	using value_type = T;
+	template<typename U> struct rebind { using other = AlignedAllocator<U, alignment>; };
+
+	AlignedAllocator() = default;
+	template<typename U> AlignedAllocator(AlignedAllocator<U, alignment> const &) {}
+
+	T * allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+		return (T*)::operator new(n * sizeof(T), std::align_val_t(alignment));
+	}
+	void deallocate(T * p, std::size_t) {
+		::operator delete(p, std::align_val_t(alignment));
+	}
+
+	template<typename U> bool operator==(AlignedAllocator<U, alignment> const &) const { return true; }
+};
+
+/*
+aligned to 2MB pages, and hinted to the OS to back with transparent huge pages where supported (Linux madvise).
+Buffers smaller than a huge page fall back on cache line alignment.
+*/
+template<typename T>
+struct HugePageAllocator {
+	static constexpr std::size_t hugePageSize = 2 << 20;
+	using value_type = T;
+	template<typename U> struct rebind { using other = HugePageAllocator<U>; };
+
+	HugePageAllocator() = default;
+	template<typename U> HugePageAllocator(HugePageAllocator<U> const &) {}
+
+	static std::size_t alignmentFor(std::size_t bytes) {
+		return bytes >= hugePageSize ? hugePageSize : 64;
+	}
+
+	T * allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+		std::size_t const bytes = n * sizeof(T);
+		T * p = (T*)::operator new(bytes, std::align_val_t(alignmentFor(bytes)));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (bytes >= hugePageSize) madvise(p, bytes, MADV_HUGEPAGE);	// only a hint, ignore failure
+#endif
+		return p;
+	}
+	void deallocate(T * p, std::size_t n) {
+		::operator delete(p, std::align_val_t(alignmentFor(n * sizeof(T))));
+	}
+
+	template<typename U> bool operator==(HugePageAllocator<U> const &) const { return true; }
+};
+
+/*
+pool of freed buffers, binned by byte size, for scratch grids that are repeatedly created and destroyed with the same sizes.
+Buffers are cache-line aligned.  They are only given back to the system upon release() or destruction.
+Thread-safe.
+*/
+struct GridPool {
+	static constexpr std::size_t alignment = 64;
+
+	GridPool() = default;
+	GridPool(GridPool const &) = delete;
+	GridPool & operator=(GridPool const &) = delete;
+	~GridPool() { release(); }
+
+	void * allocate(std::size_t bytes) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto i = freeBuffers.find(bytes);
+			if (i != freeBuffers.end() && !i->second.empty()) {
+				void * p = i->second.back();
+				i->second.pop_back();
+				return p;
+			}
+		}
+		return ::operator new(bytes, std::align_val_t(alignment));
+	}
+
+	void deallocate(void * p, std::size_t bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		freeBuffers[bytes].push_back(p);
+	}
+
+	// free all pooled buffers
+	void release() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & [bytes, buffers] : freeBuffers) {
+			for (void * p : buffers) {
+				::operator delete(p, std::align_val_t(alignment));
+			}
+		}
+		freeBuffers.clear();
+	}
+
+	// number of buffers currently pooled
+	std::size_t numFree() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::size_t n = {};
+		for (auto const & [bytes, buffers] : freeBuffers) n += buffers.size();
+		return n;
+	}
+
+	static GridPool & global() {
+		static GridPool pool;
+		return pool;
+	}
+
+protected:
+	std::mutex mutex;
+	std::map<std::size_t, std::vector<void*>> freeBuffers;
+};
+
+// allocates from a GridPool, the global pool by default
+template<typename T>
+struct GridPoolAllocator {
+	static_assert(alignof(T) <= GridPool::alignment);
+	using value_type = T;
+	template<typename U> struct rebind { using other = GridPoolAllocator<U>; };
+
+	GridPool * pool = &GridPool::global();
+
+	GridPoolAllocator() = default;
+	GridPoolAllocator(GridPool & pool_) : pool(&pool_) {}
+	template<typename U> GridPoolAllocator(GridPoolAllocator<U> const & o) : pool(o.pool) {}
+
+	T * allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+		return (T*)pool->allocate(n * sizeof(T));
+	}
+	void deallocate(T * p, std::size_t n) {
+		pool->deallocate(p, n * sizeof(T));
+	}
+
+	template<typename U> bool operator==(GridPoolAllocator<U> const & o) const { return pool == o.pool; }
+};
+
+}
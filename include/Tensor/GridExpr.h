@@ -0,0 +1,280 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Tensor/Parallel.h"
+#include "Common/Exception.h"
+#include <tuple>
+#include <functional>	//plus, minus, multiplies, divides, negate
+#include <type_traits>
+#include <utility>
+
+/*
+lazy whole-Grid arithmetic.
+
+a + b, dt * a, -a, etc for Grids and GridViews produce GridExpr's instead of Grids.
+Nothing is evaluated or allocated until a GridExpr is assigned:
+	u = u + dt * (gridApply(f, a) - b);
+does one pass over the cells, with u(i) = u(i) + dt * (f(a(i)) - b(i)) using the per-cell Type's own operators, so it works with Grid<float3>, Grid<sym3> etc.
+gridApply(f, args...) calls f per-cell, for anything else.
+Non-grid operands are per-cell constants, captured by value.
+
+Grid operands are held as views, so don't hold onto GridExprs past the lifetime of their Grids.
+Assigning reads and writes each cell once, so the destination can appear in the expression at its same cells.
+If it appears any other way, i.e. a shifted subregion, then the expression is evaluated into a temporary first.
+
+Grid::operator= and the Grid ctor evaluate serially, parallelAssign(dst, expr, policy) evaluates in parallel.
+When all operands and the destination are contiguous the loop is over flat indexes, for the compiler to vectorize.
+*/
+
+namespace Tensor {
+
+template<typename T> struct is_grid_impl : std::false_type {};
+template<typename T, int rank, typename A> struct is_grid_impl<Grid<T, rank, A>> : std::true_type {};
+template<typename T> concept is_grid_v = is_grid_impl<std::decay_t<T>>::value;
+
+template<typename T> struct is_grid_view_impl : std::false_type {};
+template<typename T, int rank> struct is_grid_view_impl<GridView<T, rank>> : std::true_type {};
+template<typename T> concept is_grid_view_v = is_grid_view_impl<std::decay_t<T>>::value;
+
+template<typename T> struct is_grid_expr_impl : std::false_type {};
+template<typename F, typename... Args> struct is_grid_expr_impl<GridExpr<F, Args...>> : std::true_type {};
+template<typename T> concept is_grid_expr_v = is_grid_expr_impl<std::decay_t<T>>::value;
+
+// anything that makes a grid-valued expression
+template<typename T> concept is_grid_operand_v = is_grid_v<T> || is_grid_view_v<T> || is_grid_expr_v<T>;
+
+// extent in memory of a view, for alias testing.  assumes non-negative steps.
+template<typename T, int rank>
+std::pair<void const *, void const *> gridViewExtent(GridView<T, rank> const & v) {
+	if (!v.size.product()) return {};
+	int last = 0;
+	for (int i = 0; i < rank; ++i) last += (v.size(i) - 1) * v.step(i);
+	return {(void const *)v.v, (void const *)(v.v + last + 1)};
+}
+
+// a Grid or GridView operand
+template<typename Type_, int rank_>
+struct GridExprLeaf {
+	using Type = Type_;
+	static constexpr int rank = rank_;
+	using intN = Tensor::intN<rank>;
+	GridView<Type const, rank> view;
+
+	Type const & operator()(intN const & i) const { return view(i); }
+	Type const & flat(int k) const { return view.v[k]; }
+	bool isContiguous() const { return view.isContiguous(); }
+
+	// true if this reads dst's memory at any cell other than its own
+	template<typename DstType>
+	bool misaligned(GridView<DstType, rank> const & dst) const {
+		auto const [b1, e1] = gridViewExtent(view);
+		auto const [b2, e2] = gridViewExtent(dst);
+		if (!b1 || !b2 || !(std::less<void const *>()(b1, e2) && std::less<void const *>()(b2, e1))) return false;
+		return (void const *)view.v != (void const *)dst.v || view.step != dst.step;
+	}
+};
+
+// a per-cell constant
+template<typename Type_>
+struct GridExprConst {
+	using Type = Type_;
+	static constexpr int rank = 0;	// no size of its own
+	Type value;
+
+	template<typename I> Type const & operator()(I const &) const { return value; }
+	Type const & flat(int) const { return value; }
+	bool isContiguous() const { return true; }
+	template<typename V> bool misaligned(V const &) const { return false; }
+};
+
+template<typename T>
+auto gridExprArg(T const & x) {
+	if constexpr (is_grid_expr_v<T>) {
+		return x;
+	} else if constexpr (is_grid_v<T> || is_grid_view_v<T>) {
+		using Type = std::remove_const_t<typename T::Type>;
+		return GridExprLeaf<Type, T::rank>{GridView<Type const, T::rank>(x.v, x.size, x.step)};
+	} else {
+		return GridExprConst<T>{x};
+	}
+}
+
+template<typename T>
+using GridExprArg = decltype(gridExprArg(std::declval<T const &>()));
+
+/*
+per-cell f(args(i)...)
+Args are GridExprLeaf, GridExprConst, or GridExpr.
+*/
+template<typename F, typename... Args>
+struct GridExpr {
+	static constexpr int rank = std::max({Args::rank...});
+	static_assert(rank > 0, "GridExpr needs at least one grid operand");
+	static_assert(((Args::rank == 0 || Args::rank == rank) && ...), "GridExpr operands must have the same rank");
+	using intN = Tensor::intN<rank>;
+	using Type = std::decay_t<std::invoke_result_t<F const &, typename Args::Type const &...>>;
+
+	F f;
+	std::tuple<Args...> args;
+	intN size;
+
+	GridExpr(F f_, Args... args_)
+	: f(std::move(f_)), args(std::move(args_)...) {
+		bool first = true;
+		std::apply([&](auto const & ... a) {
+			([&](auto const & arg) {
+				if constexpr (std::decay_t<decltype(arg)>::rank > 0) {
+					auto const & argSize = getSize(arg);
+					if (first) {
+						size = argSize;
+						first = false;
+					} else if (argSize != size) {
+						throw Common::Exception() << "GridExpr operands have sizes " << size << " and " << argSize;
+					}
+				}
+			}(a), ...);
+		}, args);
+	}
+
+	Type operator()(intN const & i) const {
+		return std::apply([&](auto const & ... a) -> Type {
+			return f(a(i)...);
+		}, args);
+	}
+
+	// for when everything is contiguous and the same size, so flat index k is the same cell in each
+	Type flat(int k) const {
+		return std::apply([&](auto const & ... a) -> Type {
+			return f(a.flat(k)...);
+		}, args);
+	}
+
+	bool isContiguous() const {
+		return std::apply([](auto const & ... a) { return (a.isContiguous() && ...); }, args);
+	}
+
+	template<typename V>
+	bool misaligned(V const & dst) const {
+		return std::apply([&](auto const & ... a) { return (a.misaligned(dst) || ...); }, args);
+	}
+
+protected:
+	template<typename A>
+	static intN const & getSize(A const & a) {
+		if constexpr (requires { a.view; }) {
+			return a.view.size;
+		} else {
+			return a.size;
+		}
+	}
+};
+
+// lazy per-cell f(args(i)...)
+template<typename F, typename... Ts>
+requires (is_grid_operand_v<Ts> || ...)
+auto gridApply(F f, Ts const & ... ts) {
+	return GridExpr<F, GridExprArg<Ts>...>(std::move(f), gridExprArg(ts)...);
+}
+
+/*
+evaluate e into dst.
+dst must be the same size as e.
+null policy means serial.
+*/
+template<typename DstType, int rank, typename F, typename... Args>
+void gridExprEval(GridView<DstType, rank> const & dst, GridExpr<F, Args...> const & e, ParallelPolicy const * policy) {
+	if (dst.size != e.size) throw Common::Exception() << "tried to assign an expression of size " << e.size << " into size " << dst.size;
+	if (e.misaligned(dst)) {
+		auto const tmp = Grid<typename GridExpr<F, Args...>::Type, rank>(dst.size, GridNoInit());
+		gridExprEval(GridView<typename GridExpr<F, Args...>::Type, rank>(tmp.v, tmp.size, tmp.step), e, policy);
+		if (policy) {
+			parallelTransform(dst, tmp, [](auto const & x) -> decltype(auto) { return x; }, *policy);
+		} else {
+			for (auto i : dst.range()) dst(i) = tmp(i);
+		}
+		return;
+	}
+	int const n = dst.size.product();
+	if (dst.isContiguous() && e.isContiguous()) {
+		auto block = [&](int begin, int end) {
+			auto const ec = e;
+			DstType * const dv = dst.v;
+			for (int k = begin; k < end; ++k) {
+				dv[k] = ec.flat(k);
+			}
+		};
+		if (policy) {
+			parallelForBlocks(n, block, *policy);
+		} else {
+			block(0, n);
+		}
+	} else {
+		if (policy) {
+			parallelFor(dst.size, [&](intN<rank> const & i) {
+				dst(i) = e(i);
+			}, *policy);
+		} else {
+			for (auto i : dst.range()) dst(i) = e(i);
+		}
+	}
+}
+
+// dst = e, for a Grid (resized if needed) or GridView dst
+template<typename D, typename F, typename... Args>
+void gridAssign(D && dst, GridExpr<F, Args...> const & e, ParallelPolicy const * policy = nullptr) {
+	if constexpr (is_grid_v<D>) {
+		if (dst.size != e.size) {
+			using G = std::decay_t<D>;
+			auto result = G(e.size, GridNoInit(), dst.alloc);
+			gridExprEval(result.view(), e, policy);
+			dst = std::move(result);
+			return;
+		}
+		gridExprEval(dst.view(), e, policy);
+	} else {
+		gridExprEval(dst, e, policy);
+	}
+}
+
+template<typename D, typename F, typename... Args>
+void parallelAssign(D && dst, GridExpr<F, Args...> const & e, ParallelPolicy const & policy = {}) {
+	gridAssign(dst, e, &policy);
+}
+
+/*
+operators
+The overloads with an explicit grid type on one side and a tensor on the other
+are more specialized than the tensor-scalar operators, which would otherwise match as well.
+*/
+
+#define TENSOR_GRID_EXPR_BINARY_OP(op, Op)\
+template<typename A, typename B>\
+requires ((is_grid_operand_v<A> || is_grid_operand_v<B>) && !is_tensor_v<A> && !is_tensor_v<B>)\
+auto operator op(A const & a, B const & b) {\
+	return gridApply(Op(), a, b);\
+}\
+template<typename A, typename T, int rank, typename Al> requires is_tensor_v<A>\
+auto operator op(A const & a, Grid<T, rank, Al> const & b) { return gridApply(Op(), a, b); }\
+template<typename A, typename T, int rank> requires is_tensor_v<A>\
+auto operator op(A const & a, GridView<T, rank> const & b) { return gridApply(Op(), a, b); }\
+template<typename A, typename F, typename... Args> requires is_tensor_v<A>\
+auto operator op(A const & a, GridExpr<F, Args...> const & b) { return gridApply(Op(), a, b); }\
+template<typename T, int rank, typename Al, typename B> requires is_tensor_v<B>\
+auto operator op(Grid<T, rank, Al> const & a, B const & b) { return gridApply(Op(), a, b); }\
+template<typename T, int rank, typename B> requires is_tensor_v<B>\
+auto operator op(GridView<T, rank> const & a, B const & b) { return gridApply(Op(), a, b); }\
+template<typename F, typename... Args, typename B> requires is_tensor_v<B>\
+auto operator op(GridExpr<F, Args...> const & a, B const & b) { return gridApply(Op(), a, b); }
+
+TENSOR_GRID_EXPR_BINARY_OP(+, std::plus<>)
+TENSOR_GRID_EXPR_BINARY_OP(-, std::minus<>)
+TENSOR_GRID_EXPR_BINARY_OP(*, std::multiplies<>)
+TENSOR_GRID_EXPR_BINARY_OP(/, std::divides<>)
+
+template<typename A>
+requires is_grid_operand_v<A>
+auto operator-(A const & a) {
+	return gridApply(std::negate<>(), a);
+}
+
+}
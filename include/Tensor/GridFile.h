@@ -0,0 +1,384 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Common/Exception.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>	//memcpy
+#include <type_traits>
+#include <utility>
+
+/*
+chunked binary files of Grids.
+
+File layout, all integers in the writer's native byte order:
+	char[8]		magic "TNSRGRID"
+	u32			version
+	u32			0x01020304, for detecting byte order
+	u32			rank
+	i32[rank]	size
+	i32[rank]	chunk size
+	char		scalar kind: 'f' float, 'i' signed int, 'u' unsigned int, 'b' bool, '?' anything else
+	u32			bytes per scalar
+	u32			bytes per cell, sizeof(Type)
+	u32, char[]	tensor storage of the cell Type, i.e. "s 3, 3" for vec<sym3,3>, or "" for scalars.  Each nesting is its tensorxStr().
+	u64			number of chunks
+	u64			file offset of the chunk index, 0 until the writer is closed
+	...			chunks, in the order they were written
+	index: per chunk in chunk order (first chunk index fastest): u64 file offset, u64 bytes, u64 checksum
+
+Each chunk is the cells of one chunk-size box of the grid, clamped at the far edges, in Grid's order, first index fastest.
+Chunks are written raw, so Type must be trivially copyable.
+
+writeGridFile(filename, grid) and readGridFile<Type, rank>(filename) do whole grids.
+GridFileWriter writes chunks as they are ready, in any order, for streaming.
+GridFileReader reads subregions, loading only the chunks that overlap them, and verifies each chunk's checksum.
+*/
+
+namespace Tensor {
+
+// 64-bit FNV-style hash over 8-byte words, then the remaining bytes
+inline std::uint64_t gridFileChecksum(void const * data, std::size_t n) {
+	constexpr std::uint64_t prime = 0x100000001b3ull;
+	std::uint64_t h = 0xcbf29ce484222325ull;
+	auto const * p = (unsigned char const *)data;
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		std::uint64_t w;
+		std::memcpy(&w, p + i, 8);
+		h = (h ^ w) * prime;
+		h ^= h >> 29;
+	}
+	for (; i < n; ++i) {
+		h = (h ^ p[i]) * prime;
+	}
+	return h;
+}
+
+template<typename Type>
+struct GridFileTypeInfo {
+	using Scalar = typename decltype([]() {
+		if constexpr (is_tensor_v<Type>) {
+			return std::type_identity<typename Type::Scalar>();
+		} else {
+			return std::type_identity<Type>();
+		}
+	}())::type;
+
+	static constexpr char scalarKind =
+		std::is_same_v<Scalar, bool> ? 'b'
+		: std::is_floating_point_v<Scalar> ? 'f'
+		: std::is_integral_v<Scalar> && std::is_signed_v<Scalar> ? 'i'
+		: std::is_integral_v<Scalar> ? 'u'
+		: '?';
+
+	static std::string storage() {
+		if constexpr (is_tensor_v<Type>) {
+			return []<int... i>(std::integer_sequence<int, i...>) -> std::string {
+				std::string result;
+				((result += (i ? ", " : "") + Type::template Nested<i>::tensorxStr()), ...);
+				return result;
+			}(std::make_integer_sequence<int, Type::numNestings>{});
+		} else {
+			return {};
+		}
+	}
+};
+
+template<int rank>
+struct GridFileHeader {
+	static constexpr char magic[8] = {'T','N','S','R','G','R','I','D'};
+	static constexpr std::uint32_t version = 1;
+	static constexpr std::uint32_t byteOrder = 0x01020304;
+
+	intN<rank> size;
+	intN<rank> chunkSize;
+	char scalarKind = {};
+	std::uint32_t scalarBytes = {};
+	std::uint32_t cellBytes = {};
+	std::string storage;
+	std::uint64_t numChunks = {};
+	std::uint64_t indexOffset = {};
+
+	intN<rank> chunkCounts() const {
+		return intN<rank>([&](int i) -> int { return (size(i) + chunkSize(i) - 1) / chunkSize(i); });
+	}
+
+	// first cell of chunk 'chunk'
+	intN<rank> chunkMin(intN<rank> const & chunk) const {
+		return intN<rank>([&](int i) -> int { return chunk(i) * chunkSize(i); });
+	}
+
+	// cells of chunk 'chunk', clamped at the far edges
+	intN<rank> chunkExtent(intN<rank> const & chunk) const {
+		return intN<rank>([&](int i) -> int { return std::min(chunkSize(i), size(i) - chunk(i) * chunkSize(i)); });
+	}
+
+	// byte position of indexOffset within the header
+	std::uint64_t indexOffsetPos() const {
+		return 8 + 4 * 3 + 8 * rank + 1 + 4 * 2 + 4 + storage.size() + 8;
+	}
+
+	// position of chunk in the index, chunks ordered with the first index fastest
+	int chunkIndex(intN<rank> const & chunk) const {
+		auto const counts = chunkCounts();
+		for (int i = 0; i < rank; ++i) {
+			if (chunk(i) < 0 || chunk(i) >= counts(i)) throw Common::Exception() << "chunk " << chunk << " is out of bounds of chunk counts " << counts;
+		}
+		return chunk.dot(stepForSize(counts));
+	}
+
+	template<typename Type>
+	static GridFileHeader forType(intN<rank> const & size, intN<rank> const & chunkSize) {
+		// before chunkCounts() divides by it
+		for (int i = 0; i < rank; ++i) {
+			if (size(i) < 0) throw Common::Exception() << "size " << size << " is negative";
+			if (chunkSize(i) < 1) throw Common::Exception() << "chunk size " << chunkSize << " must be positive";
+		}
+		GridFileHeader h;
+		h.size = size;
+		h.chunkSize = chunkSize;
+		h.scalarKind = GridFileTypeInfo<Type>::scalarKind;
+		h.scalarBytes = sizeof(typename GridFileTypeInfo<Type>::Scalar);
+		h.cellBytes = sizeof(Type);
+		h.storage = GridFileTypeInfo<Type>::storage();
+		h.numChunks = h.chunkCounts().product();
+		return h;
+	}
+
+	template<typename T>
+	static void put(std::ostream & o, T const & x) { o.write((char const *)&x, sizeof(T)); }
+
+	template<typename T>
+	static T get(std::istream & i) {
+		T x;
+		if (!i.read((char *)&x, sizeof(T))) throw Common::Exception() << "grid file header is truncated";
+		return x;
+	}
+
+	void write(std::ostream & o) const {
+		o.write(magic, 8);
+		put(o, version);
+		put(o, byteOrder);
+		put(o, (std::uint32_t)rank);
+		for (int i = 0; i < rank; ++i) put(o, (std::int32_t)size(i));
+		for (int i = 0; i < rank; ++i) put(o, (std::int32_t)chunkSize(i));
+		put(o, scalarKind);
+		put(o, scalarBytes);
+		put(o, cellBytes);
+		put(o, (std::uint32_t)storage.size());
+		o.write(storage.data(), storage.size());
+		put(o, numChunks);
+		put(o, indexOffset);
+	}
+
+	static GridFileHeader read(std::istream & i) {
+		char m[8];
+		if (!i.read(m, 8) || std::memcmp(m, magic, 8)) throw Common::Exception() << "not a grid file";
+		if (get<std::uint32_t>(i) != version) throw Common::Exception() << "unknown grid file version";
+		if (get<std::uint32_t>(i) != byteOrder) throw Common::Exception() << "grid file has a different byte order";
+		auto const fileRank = get<std::uint32_t>(i);
+		if (fileRank != rank) throw Common::Exception() << "grid file has rank " << fileRank << " but expected " << rank;
+		GridFileHeader h;
+		for (int j = 0; j < rank; ++j) h.size(j) = get<std::int32_t>(i);
+		for (int j = 0; j < rank; ++j) h.chunkSize(j) = get<std::int32_t>(i);
+		h.scalarKind = get<char>(i);
+		h.scalarBytes = get<std::uint32_t>(i);
+		h.cellBytes = get<std::uint32_t>(i);
+		h.storage.resize(get<std::uint32_t>(i));
+		if (!i.read(h.storage.data(), h.storage.size())) throw Common::Exception() << "grid file header is truncated";
+		h.numChunks = get<std::uint64_t>(i);
+		h.indexOffset = get<std::uint64_t>(i);
+		for (int j = 0; j < rank; ++j) {
+			if (h.size(j) < 0 || h.chunkSize(j) < 1) throw Common::Exception() << "grid file has bad size " << h.size << " or chunk size " << h.chunkSize;
+		}
+		if (h.numChunks != (std::uint64_t)h.chunkCounts().product()) throw Common::Exception() << "grid file has " << h.numChunks << " chunks but expected " << h.chunkCounts().product();
+		return h;
+	}
+
+	// throws if the file's cell type doesn't match Type
+	template<typename Type>
+	void checkType() const {
+		auto const expected = forType<Type>(size, chunkSize);
+		if (scalarKind != expected.scalarKind || scalarBytes != expected.scalarBytes || cellBytes != expected.cellBytes || storage != expected.storage) {
+			throw Common::Exception() << "grid file holds scalar " << scalarKind << scalarBytes * 8 << " storage \"" << storage << "\" cells of " << cellBytes << " bytes"
+				<< " but expected scalar " << expected.scalarKind << expected.scalarBytes * 8 << " storage \"" << expected.storage << "\" cells of " << expected.cellBytes << " bytes";
+		}
+	}
+};
+
+struct GridFileChunkEntry {
+	std::uint64_t offset = {};
+	std::uint64_t bytes = {};
+	std::uint64_t checksum = {};
+};
+
+/*
+streaming writer.
+Chunks can be written in any order, each exactly once, before close().
+*/
+template<typename Type, int rank>
+struct GridFileWriter {
+	static_assert(std::is_trivially_copyable_v<Type>, "grid files store raw bytes");
+	using intN = Tensor::intN<rank>;
+
+	GridFileHeader<rank> header;
+	std::ofstream o;
+	std::vector<GridFileChunkEntry> index;
+	std::vector<bool> written;
+	Grid<Type, rank> scratch;
+
+	GridFileWriter(std::string const & filename, intN const & size, intN const & chunkSize = intN(32))
+	:	header(GridFileHeader<rank>::template forType<Type>(size, chunkSize)),
+		o(filename, std::ios::binary | std::ios::trunc)
+	{
+		if (!o) throw Common::Exception() << "failed to open " << filename;
+		header.write(o);
+		index.resize(header.numChunks);
+		written.resize(header.numChunks);
+	}
+
+	~GridFileWriter() {
+		// don't throw from the dtor, an unclosed file is left without an index
+		if (o.is_open()) {
+			try { close(); } catch (...) {}
+		}
+	}
+
+	intN chunkCounts() const { return header.chunkCounts(); }
+
+	// cells of chunk 'chunk', clamped at the far edges
+	std::pair<intN, intN> chunkBox(intN const & chunk) const {
+		return {header.chunkMin(chunk), header.chunkExtent(chunk)};
+	}
+
+	// src is the cells of chunkBox(chunk)
+	template<typename SrcType>
+	requires (std::is_same_v<std::remove_const_t<SrcType>, Type>)
+	void writeChunk(intN const & chunk, GridView<SrcType, rank> const & src) {
+		int const c = header.chunkIndex(chunk);
+		auto const [min, extent] = chunkBox(chunk);
+		if (src.size != extent) throw Common::Exception() << "chunk " << chunk << " is size " << extent << " but was given " << src.size;
+		if (written[c]) throw Common::Exception() << "chunk " << chunk << " was already written";
+		Type const * data = src.v;
+		if (!src.isContiguous()) {
+			scratch.copyFrom(src);
+			data = scratch.v;
+		}
+		std::size_t const bytes = sizeof(Type) * extent.product();
+		index[c] = {(std::uint64_t)o.tellp(), bytes, gridFileChecksum(data, bytes)};
+		o.write((char const *)data, bytes);
+		if (!o) throw Common::Exception() << "failed writing chunk " << chunk;
+		written[c] = true;
+	}
+
+	// writes every chunk within src, which is the whole grid
+	void writeAll(GridView<Type const, rank> const & src) {
+		if (src.size != header.size) throw Common::Exception() << "grid file is size " << header.size << " but was given " << src.size;
+		for (auto chunk : RangeObj<rank>(intN(), chunkCounts())) {
+			auto const [min, extent] = chunkBox(chunk);
+			writeChunk(chunk, src.sub(min, extent));
+		}
+	}
+
+	void close() {
+		for (std::size_t c = 0; c < written.size(); ++c) {
+			if (!written[c]) {
+				o.close();
+				throw Common::Exception() << "closing a grid file with chunk " << c << " unwritten";
+			}
+		}
+		header.indexOffset = (std::uint64_t)o.tellp();
+		for (auto const & e : index) {
+			GridFileHeader<rank>::put(o, e.offset);
+			GridFileHeader<rank>::put(o, e.bytes);
+			GridFileHeader<rank>::put(o, e.checksum);
+		}
+		o.seekp(header.indexOffsetPos());
+		GridFileHeader<rank>::put(o, header.indexOffset);
+		o.close();
+		if (o.fail()) throw Common::Exception() << "failed writing grid file";
+	}
+};
+
+template<typename Type, int rank>
+struct GridFileReader {
+	static_assert(std::is_trivially_copyable_v<Type>, "grid files store raw bytes");
+	using intN = Tensor::intN<rank>;
+
+	GridFileHeader<rank> header;
+	std::ifstream i;
+	std::vector<GridFileChunkEntry> index;
+
+	GridFileReader(std::string const & filename)
+	: i(filename, std::ios::binary) {
+		if (!i) throw Common::Exception() << "failed to open " << filename;
+		header = GridFileHeader<rank>::read(i);
+		header.template checkType<Type>();
+		if (!header.indexOffset) throw Common::Exception() << filename << " has no chunk index, it was never closed";
+		i.seekg(header.indexOffset);
+		index.resize(header.numChunks);
+		for (auto & e : index) {
+			e.offset = GridFileHeader<rank>::template get<std::uint64_t>(i);
+			e.bytes = GridFileHeader<rank>::template get<std::uint64_t>(i);
+			e.checksum = GridFileHeader<rank>::template get<std::uint64_t>(i);
+		}
+	}
+
+	intN const & size() const { return header.size; }
+	intN chunkCounts() const { return header.chunkCounts(); }
+
+	// reads and verifies one chunk
+	Grid<Type, rank> readChunk(intN const & chunk) {
+		auto const & e = index[header.chunkIndex(chunk)];
+		intN const extent = header.chunkExtent(chunk);
+		if (e.bytes != sizeof(Type) * extent.product()) throw Common::Exception() << "chunk " << chunk << " has " << e.bytes << " bytes but expected " << sizeof(Type) * extent.product();
+		auto result = Grid<Type, rank>(extent, GridNoInit());
+		i.seekg(e.offset);
+		if (!i.read((char *)result.v, e.bytes)) throw Common::Exception() << "failed reading chunk " << chunk;
+		if (gridFileChecksum(result.v, e.bytes) != e.checksum) throw Common::Exception() << "chunk " << chunk << " failed its checksum";
+		return result;
+	}
+
+	// cells [min, min+subsize), reading only the chunks that overlap
+	Grid<Type, rank> read(intN const & min, intN const & subsize) {
+		for (int j = 0; j < rank; ++j) {
+			if (min(j) < 0 || subsize(j) < 0 || min(j) + subsize(j) > header.size(j)) {
+				throw Common::Exception() << "subregion min " << min << " size " << subsize << " is out of bounds of size " << header.size;
+			}
+		}
+		auto result = Grid<Type, rank>(subsize, GridNoInit());
+		if (!subsize.product()) return result;
+		intN const firstChunk([&](int j) -> int { return min(j) / header.chunkSize(j); });
+		intN const lastChunk([&](int j) -> int { return (min(j) + subsize(j) - 1) / header.chunkSize(j); });
+		for (auto chunk : RangeObj<rank>(firstChunk, lastChunk + 1)) {
+			auto const data = readChunk(chunk);
+			intN const chunkMin = header.chunkMin(chunk);
+			// overlap of the chunk and the subregion
+			intN const lo([&](int j) -> int { return std::max(min(j), chunkMin(j)); });
+			intN const hi([&](int j) -> int { return std::min(min(j) + subsize(j), chunkMin(j) + data.size(j)); });
+			copyGridView(result.sub(lo - min, hi - lo), data.sub(lo - chunkMin, hi - lo));
+		}
+		return result;
+	}
+
+	Grid<Type, rank> readAll() {
+		return read(intN(), header.size);
+	}
+};
+
+template<typename Type, int rank, typename Allocator>
+void writeGridFile(std::string const & filename, Grid<Type, rank, Allocator> const & grid, intN<rank> const & chunkSize = intN<rank>(32)) {
+	auto w = GridFileWriter<Type, rank>(filename, grid.size, chunkSize);
+	w.writeAll(grid.view());
+	w.close();
+}
+
+template<typename Type, int rank>
+Grid<Type, rank> readGridFile(std::string const & filename) {
+	return GridFileReader<Type, rank>(filename).readAll();
+}
+
+}
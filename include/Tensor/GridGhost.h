@@ -0,0 +1,223 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Common/Exception.h"
+#include <array>
+#include <functional>
+
+/*
+Grids with a layer of ghost cells around them, so stencils can read past the edges without branching.
+
+GhostGrid<Type, rank> g(size, ghost) has interior cells [0,size) and ghost cells out to [-ghost, size+ghost) in every dimension.
+g(i) is valid for any i in that extended range.
+g.fillGhosts() sets every ghost cell by the boundary condition of its side, GridBoundary:
+	periodic = wrap around to the other side
+	mirror = reflect across the face, g(-1-k) = g(k)
+	constant(value)
+	extrapolate = linear extrapolation from the two outermost interior cells
+	callback(f) = f(ghostIndex)
+Each ghost cell is written once.  Dimensions are filled in order, each over the ghost range of the dimensions before it,
+so edges and corners take the boundary condition of the last dimension they are a ghost in.
+*/
+
+namespace Tensor {
+
+template<typename Type, int rank>
+struct GridBoundary {
+	enum Kind { Periodic, Mirror, Constant, Extrapolate, Callback };
+	Kind kind = Periodic;
+	Type value = {};
+	std::function<Type(intN<rank> const &)> f = {};
+
+	static GridBoundary periodic() { return {.kind = Periodic}; }
+	static GridBoundary mirror() { return {.kind = Mirror}; }
+	static GridBoundary constant(Type const & value) { return {.kind = Constant, .value = value}; }
+	static GridBoundary extrapolate() { return {.kind = Extrapolate}; }
+	static GridBoundary callback(std::function<Type(intN<rank> const &)> f) { return {.kind = Callback, .f = f}; }
+};
+
+template<
+	typename Type_,
+	int rank_,
+	typename Allocator_ = AlignedAllocator<Type_, std::max<std::size_t>(64, alignof(Type_))>
+>
+struct GhostGrid {
+	using Type = Type_;
+	using value_type = Type;
+	static constexpr auto rank = rank_;
+	using intN = Tensor::intN<rank>;
+	using Allocator = Allocator_;
+	using Boundary = GridBoundary<Type, rank>;
+
+	intN size;	// of the interior
+	int ghost = {};
+	Grid<Type, rank, Allocator> grid;	// interior and ghost cells
+	Type * origin = {};	// interior cell 0
+
+	// boundaries[d][0] is the low side of dimension d, boundaries[d][1] the high side
+	std::array<std::array<Boundary, 2>, rank> boundaries;
+
+	GhostGrid() {}
+
+	// zero-initialized
+	GhostGrid(intN const & size_, int ghost_, Boundary const & boundary = {}, Allocator const & alloc_ = {})
+	:	size(size_),
+		ghost(checkGhost(ghost_)),
+		grid(size_ + 2 * ghost_, alloc_)
+	{
+		origin = grid.v + intN(ghost).dot(grid.step);
+		setBoundary(boundary);
+	}
+
+	GhostGrid(GhostGrid const & src)
+	:	size(src.size),
+		ghost(src.ghost),
+		grid(src.grid),
+		origin(grid.v + intN(ghost).dot(grid.step)),
+		boundaries(src.boundaries)
+	{}
+
+	GhostGrid(GhostGrid && src)
+	:	size(src.size),
+		ghost(src.ghost),
+		grid(std::move(src.grid)),
+		origin(src.origin),
+		boundaries(std::move(src.boundaries))
+	{
+		src.origin = nullptr;
+	}
+
+	GhostGrid & operator=(GhostGrid const & src) {
+		if (this != &src) *this = GhostGrid(src);
+		return *this;
+	}
+
+	GhostGrid & operator=(GhostGrid && src) {
+		size = src.size;
+		ghost = src.ghost;
+		grid = std::move(src.grid);
+		origin = src.origin;
+		boundaries = std::move(src.boundaries);
+		src.origin = nullptr;
+		return *this;
+	}
+
+	void setBoundary(Boundary const & boundary) {
+		for (auto & sides : boundaries) sides = {boundary, boundary};
+	}
+
+	void setBoundary(int dim, int side, Boundary const & boundary) {
+		boundaries[dim][side] = boundary;
+	}
+
+	// i can be in [-ghost, size+ghost)
+	Type & operator()(intN const & i) {
+#ifdef DEBUG
+		checkIndex(i);
+#endif
+		return origin[i.dot(grid.step)];
+	}
+
+	Type const & operator()(intN const & i) const {
+#ifdef DEBUG
+		checkIndex(i);
+#endif
+		return origin[i.dot(grid.step)];
+	}
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Type & operator()(Ints... is) { return (*this)(intN((int)is...)); }
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Type const & operator()(Ints... is) const { return (*this)(intN((int)is...)); }
+
+	// interior cells
+	RangeObj<rank> range() const {
+		return RangeObj<rank>(intN(), size);
+	}
+
+	GridView<Type, rank> interior() { return grid.sub(intN(ghost), size); }
+	GridView<Type const, rank> interior() const { return grid.sub(intN(ghost), size); }
+
+	void fillGhosts() {
+		if (!ghost) return;
+		for (int d = 0; d < rank; ++d) {
+			if ((boundaries[d][0].kind == Boundary::Mirror || boundaries[d][1].kind == Boundary::Mirror || boundaries[d][0].kind == Boundary::Periodic || boundaries[d][1].kind == Boundary::Periodic) && size(d) < ghost) {
+				throw Common::Exception() << "ghost width " << ghost << " is wider than size " << size << " along dimension " << d;
+			}
+			if ((boundaries[d][0].kind == Boundary::Extrapolate || boundaries[d][1].kind == Boundary::Extrapolate) && size(d) < 2) {
+				throw Common::Exception() << "extrapolating needs a size of at least 2, found " << size << " along dimension " << d;
+			}
+			// ghost range in dims before d, interior in dims after
+			intN min, extent;
+			for (int e = 0; e < rank; ++e) {
+				min(e) = e < d ? -ghost : 0;
+				extent(e) = e < d ? size(e) + 2 * ghost : size(e);
+			}
+			for (int side = 0; side < 2; ++side) {
+				min(d) = side ? size(d) : -ghost;
+				extent(d) = ghost;
+				fillSlab(d, side, min, extent);
+			}
+		}
+	}
+
+protected:
+	// before grid is sized by it
+	static int checkGhost(int ghost) {
+		if (ghost < 0) throw Common::Exception() << "ghost width " << ghost << " must be non-negative";
+		return ghost;
+	}
+
+	void fillSlab(int d, int side, intN const & min, intN const & extent) {
+		auto const & b = boundaries[d][side];
+		int const n = size(d);
+		switch (b.kind) {
+		case Boundary::Periodic:
+			forEachIndexInBox(min, extent, [&](intN const & i) {
+				auto src = i;
+				src(d) += side ? -n : n;
+				(*this)(i) = (*this)(src);
+			});
+			break;
+		case Boundary::Mirror:
+			forEachIndexInBox(min, extent, [&](intN const & i) {
+				auto src = i;
+				src(d) = side ? 2 * n - 1 - i(d) : -1 - i(d);
+				(*this)(i) = (*this)(src);
+			});
+			break;
+		case Boundary::Constant:
+			forEachIndexInBox(min, extent, [&](intN const & i) {
+				(*this)(i) = b.value;
+			});
+			break;
+		case Boundary::Extrapolate:
+			forEachIndexInBox(min, extent, [&](intN const & i) {
+				auto edge = i, inner = i;
+				edge(d) = side ? n - 1 : 0;
+				inner(d) = side ? n - 2 : 1;
+				int const j = side ? i(d) - (n - 1) : -i(d);
+				(*this)(i) = (Type)((*this)(edge) * (1 + j) - (*this)(inner) * j);
+			});
+			break;
+		case Boundary::Callback:
+			forEachIndexInBox(min, extent, [&](intN const & i) {
+				(*this)(i) = b.f(i);
+			});
+			break;
+		}
+	}
+
+	void checkIndex(intN const & i) const {
+		for (int d = 0; d < rank; ++d) {
+			if (i(d) < -ghost || i(d) >= size(d) + ghost) {
+				throw Common::Exception() << "size is " << size << " with ghost " << ghost << " but dereference is " << i;
+			}
+		}
+	}
+};
+
+}
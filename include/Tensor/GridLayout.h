@@ -0,0 +1,303 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Tensor/GridAllocator.h"
+#include "Common/Exception.h"
+#include <memory>
+#include <type_traits>
+
+/*
+Grids of tensors with the tensor components split apart in memory.
+
+Grid<sym3<double>, 3> stores each cell's 6 components together, aka array-of-structures.
+LayoutGrid<sym3<double>, 3, Layout> stores them by Layout:
+	GridLayoutAoS = each cell's components together, same as Grid
+	GridLayoutSoA = structure-of-arrays, every cell's first component, then every cell's second, etc
+	GridLayoutAoSoA<W> = blocks of W cells in SoA order, one block after the next
+
+Components are numbered by the tensor's write-index order, which is its storage order, from 0 to Type::totalCount-1.
+So a sym3 has 6 components xx xy yy xz yz zz, not 9.
+
+Every layout puts a cell's components at a fixed stride, so g(i) returns a LayoutGridRef proxy of the cell's first component and that stride.
+The proxy converts to and assigns from Type, or accesses single components with .component(c).
+For bulk kernels, plane(c) is a GridView of component c for AoS and SoA, and block(b) is the raw b'th block of AoSoA.
+*/
+
+namespace Tensor {
+
+struct GridLayoutAoS {
+	static constexpr int storedCells(int numCells) { return numCells; }
+	static constexpr int cellOffset(int cell, int numComponents, int) { return cell * numComponents; }
+	static constexpr int componentStride(int, int) { return 1; }
+};
+
+// each component's plane is padded to a multiple of 16 cells, so planes stay 64-byte aligned for float and double
+struct GridLayoutSoA {
+	static constexpr int padding = 16;
+	static constexpr int storedCells(int numCells) { return (numCells + padding - 1) / padding * padding; }
+	static constexpr int cellOffset(int cell, int, int) { return cell; }
+	static constexpr int componentStride(int, int storedCells_) { return storedCells_; }
+};
+
+template<int blockWidth_>
+struct GridLayoutAoSoA {
+	static_assert(blockWidth_ > 0);
+	static constexpr int blockWidth = blockWidth_;
+	static constexpr int storedCells(int numCells) { return (numCells + blockWidth - 1) / blockWidth * blockWidth; }
+	static constexpr int cellOffset(int cell, int numComponents, int) {
+		return cell / blockWidth * blockWidth * numComponents + cell % blockWidth;
+	}
+	static constexpr int componentStride(int, int) { return blockWidth; }
+};
+
+// proxy for one cell of a LayoutGrid.  ScalarConst is const for read-only access.
+template<typename Type, typename ScalarConst>
+struct LayoutGridRef {
+	using Scalar = typename Type::Scalar;
+	static constexpr int numComponents = Type::totalCount;
+
+	ScalarConst * p = {};	// the cell's component 0
+	int componentStride = {};
+
+	LayoutGridRef(ScalarConst * p_, int componentStride_)
+	: p(p_), componentStride(componentStride_) {}
+
+	LayoutGridRef(LayoutGridRef const &) = default;
+
+	ScalarConst & component(int c) const {
+		return p[c * componentStride];
+	}
+
+	Type get() const {
+		Type t;
+		int c = 0;
+		for (auto & x : t.write()) {
+			x = component(c++);
+		}
+		return t;
+	}
+
+	operator Type() const { return get(); }
+
+	LayoutGridRef const & operator=(Type const & t) const requires (!std::is_const_v<ScalarConst>) {
+		int c = 0;
+		for (auto const & x : t.write()) {
+			component(c++) = x;
+		}
+		return *this;
+	}
+
+	// assigning one proxy to another copies the cell, same as a Type & would
+	LayoutGridRef const & operator=(LayoutGridRef const & o) const requires (!std::is_const_v<ScalarConst>) {
+		return *this = o.get();
+	}
+
+	template<typename S>
+	LayoutGridRef const & operator=(LayoutGridRef<Type, S> const & o) const requires (!std::is_const_v<ScalarConst>) {
+		return *this = o.get();
+	}
+
+	// read by tensor index.  this reads the whole cell, use component() in loops.
+	template<typename... Ints>
+	requires (sizeof...(Ints) == Type::rank && (std::is_convertible_v<Ints, int> && ...))
+	Scalar operator()(Ints... is) const {
+		return (Scalar)get()(is...);
+	}
+
+	Scalar operator()(typename Type::intN const & i) const {
+		return (Scalar)get()(i);
+	}
+
+	template<typename B> LayoutGridRef const & operator+=(B const & b) const { return *this = Type(get() + b); }
+	template<typename B> LayoutGridRef const & operator-=(B const & b) const { return *this = Type(get() - b); }
+	template<typename B> LayoutGridRef const & operator*=(B const & b) const { return *this = Type(get() * b); }
+	template<typename B> LayoutGridRef const & operator/=(B const & b) const { return *this = Type(get() / b); }
+
+	bool operator==(Type const & t) const { return get() == t; }
+	bool operator!=(Type const & t) const { return !operator==(t); }
+};
+
+template<typename Type, typename ScalarConst>
+std::ostream & operator<<(std::ostream & o, LayoutGridRef<Type, ScalarConst> const & r) {
+	return o << r.get();
+}
+
+/*
+Type must be a tensor.
+Cells are in the same order as Grid, first index fastest.
+*/
+template<
+	typename Type_,
+	int rank_,
+	typename Layout_ = GridLayoutSoA,
+	typename Allocator_ = AlignedAllocator<typename Type_::Scalar, std::max<std::size_t>(64, alignof(typename Type_::Scalar))>
+>
+requires (is_tensor_v<Type_>)
+struct LayoutGrid {
+	using Type = Type_;
+	using value_type = Type;
+	using Scalar = typename Type::Scalar;
+	static constexpr auto rank = rank_;
+	using intN = Tensor::intN<rank>;
+	using Layout = Layout_;
+	using Allocator = Allocator_;
+	using AllocTraits = std::allocator_traits<Allocator>;
+	static constexpr int numComponents = Type::totalCount;
+
+	using Ref = LayoutGridRef<Type, Scalar>;
+	using ConstRef = LayoutGridRef<Type, Scalar const>;
+
+	intN size;
+	intN step;	// in cells
+	int storedCells = {};	// size.product() plus padding
+	Scalar * v = {};
+	std::shared_ptr<Scalar> buffer;
+
+	[[no_unique_address]] Allocator alloc;
+
+	LayoutGrid() {}
+
+	// zero-initialized
+	LayoutGrid(intN const & size_, Allocator const & alloc_ = {})
+	:	size(size_),
+		step(stepForSize(size_)),
+		alloc(alloc_)
+	{
+		allocBuffer();
+	}
+
+	LayoutGrid(LayoutGrid const & src)
+	:	size(src.size),
+		step(src.step),
+		alloc(AllocTraits::select_on_container_copy_construction(src.alloc))
+	{
+		allocBuffer();
+		std::copy_n(src.v, storedCells * numComponents, v);
+	}
+
+	LayoutGrid(LayoutGrid && src)
+	:	size(src.size),
+		step(src.step),
+		storedCells(src.storedCells),
+		v(src.v),
+		buffer(std::move(src.buffer)),
+		alloc(std::move(src.alloc))
+	{
+		src.v = nullptr;
+		src.storedCells = 0;
+	}
+
+	// from an AoS Grid or GridView
+	template<typename SrcType>
+	requires (std::is_same_v<std::remove_const_t<SrcType>, Type>)
+	explicit LayoutGrid(GridView<SrcType, rank> const & src, Allocator const & alloc_ = {})
+	:	size(src.size),
+		step(stepForSize(src.size)),
+		alloc(alloc_)
+	{
+		allocBuffer();
+		for (auto i : range()) {
+			(*this)(i) = src(i);
+		}
+	}
+
+	template<typename A>
+	explicit LayoutGrid(Grid<Type, rank, A> const & src, Allocator const & alloc_ = {})
+	: LayoutGrid(src.view(), alloc_) {}
+
+	LayoutGrid & operator=(LayoutGrid const & src) {
+		if (this != &src) *this = LayoutGrid(src);
+		return *this;
+	}
+
+	LayoutGrid & operator=(LayoutGrid && src) {
+		size = src.size;
+		step = src.step;
+		storedCells = src.storedCells;
+		v = src.v;
+		buffer = std::move(src.buffer);
+		alloc = std::move(src.alloc);
+		src.v = nullptr;
+		src.storedCells = 0;
+		return *this;
+	}
+
+	// back to AoS
+	Grid<Type, rank> toGrid() const {
+		auto result = Grid<Type, rank>(size, GridNoInit());
+		for (auto i : range()) {
+			result(i) = (*this)(i).get();
+		}
+		return result;
+	}
+
+	int cellIndex(intN const & i) const {
+#ifdef DEBUG
+		for (int j = 0; j < rank; ++j) {
+			if (i(j) < 0 || i(j) >= size(j)) {
+				throw Common::Exception() << "size is " << size << " but dereference is " << i;
+			}
+		}
+#endif
+		return i.dot(step);
+	}
+
+	static constexpr int componentStride(int storedCells_) {
+		return Layout::componentStride(numComponents, storedCells_);
+	}
+
+	// by flat cell index, in memory order
+	Ref cell(int k) { return Ref(v + Layout::cellOffset(k, numComponents, storedCells), componentStride(storedCells)); }
+	ConstRef cell(int k) const { return ConstRef(v + Layout::cellOffset(k, numComponents, storedCells), componentStride(storedCells)); }
+
+	Ref operator()(intN const & i) { return cell(cellIndex(i)); }
+	ConstRef operator()(intN const & i) const { return cell(cellIndex(i)); }
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Ref operator()(Ints... is) { return (*this)(intN((int)is...)); }
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	ConstRef operator()(Ints... is) const { return (*this)(intN((int)is...)); }
+
+	RangeObj<rank> range() const {
+		return RangeObj<rank>(intN(), size);
+	}
+
+	// component c of every cell, as a strided view, for AoS and SoA
+	GridView<Scalar, rank> plane(int c)
+	requires (std::is_same_v<Layout, GridLayoutAoS> || std::is_same_v<Layout, GridLayoutSoA>)
+	{
+		return GridView<Scalar, rank>(v + c * componentStride(storedCells), size, step * Layout::cellOffset(1, numComponents, storedCells));
+	}
+	GridView<Scalar const, rank> plane(int c) const
+	requires (std::is_same_v<Layout, GridLayoutAoS> || std::is_same_v<Layout, GridLayoutSoA>)
+	{
+		return GridView<Scalar const, rank>(v + c * componentStride(storedCells), size, step * Layout::cellOffset(1, numComponents, storedCells));
+	}
+
+	/*
+	AoSoA blocks
+	block(b)[c * blockWidth + j] is component c of flat cell b * blockWidth + j.
+	Cells past the end of the last block are padding.
+	*/
+	int numBlocks() const requires (requires { Layout::blockWidth; }) {
+		return storedCells / Layout::blockWidth;
+	}
+	Scalar * block(int b) requires (requires { Layout::blockWidth; }) {
+		return v + b * Layout::blockWidth * numComponents;
+	}
+	Scalar const * block(int b) const requires (requires { Layout::blockWidth; }) {
+		return v + b * Layout::blockWidth * numComponents;
+	}
+
+protected:
+	void allocBuffer() {
+		storedCells = Layout::storedCells(size.product());
+		buffer = allocGridBuffer(alloc, (std::size_t)storedCells * numComponents, true);
+		v = buffer.get();
+	}
+};
+
+}
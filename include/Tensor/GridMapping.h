@@ -0,0 +1,503 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Tensor/GridAllocator.h"
+#include "Tensor/Range.h"
+#include "Common/Exception.h"
+#include <vector>
+#include <memory>
+#include <bit>	//countr_zero
+#include <type_traits>
+
+/*
+Grids with other index-to-memory mappings than Grid's linear stepForSize.
+
+MappedGrid<Type, rank, Mapping> with Mapping:
+	GridMappingLinear = same as Grid, first index fastest
+	GridMappingTiled<brick> = bricks of brick^rank cells, each linear inside, bricks ordered linearly
+	GridMappingMorton = Z-order curve, each index's bits interleaved, dims padded up to powers of two
+
+All of these are separable: the offset of index i is table[0][i(0)] + ... + table[rank-1][i(rank-1)],
+so MappedGrid precomputes one table per dimension and access is rank lookups and adds.
+
+For cache-friendly loops, g.forEach(f) visits the cells in memory order, calling f(intN i, Type & x).
+Cells that pad partial bricks or powers of two aren't visited.
+For stencils, g.neighborOffsets<radius>(i) gives the per-dimension offsets of i's neighborhood.
+
+Both of those go through the tables for every cell.  For sweeps, each mapping also splits the grid into bricks,
+boxes of cells that are affine in memory (linear is one brick, tiled are its tiles, Morton are the 2^rank blocks of each index's lowest bit),
+and g.forEachBrick(f) hands f each brick's offset and constant steps.
+g.forEachStencilRow<radius>(f) builds on that: it hands f runs of contiguous cells along dimension 0 with their neighbor deltas,
+which are constant along the run, so the tables are only read once per run and once per cell on the bricks' faces along dimension 0.
+
+Tiling is meant to pay off once a few planes of the grid no longer fit in cache, i.e. for a 7-point stencil on doubles, 3 * size(0) * size(1) * 8 bytes.
+No speedup over GridMappingLinear has been measured yet: in test/bench up to 400^3, tiled and Morton sweeps were slower than linear,
+and those runs had no hardware counters, so no cache-miss reduction has been measured either.
+*/
+
+namespace Tensor {
+
+struct GridMappingLinear {
+	template<int rank>
+	static int storedCount(intN<rank> const & size) {
+		return size.product();
+	}
+
+	template<int rank>
+	static std::vector<int> dimTable(intN<rank> const & size, int d) {
+		auto const step = stepForSize(size);
+		std::vector<int> table(size(d));
+		for (int x = 0; x < size(d); ++x) table[x] = x * step(d);
+		return table;
+	}
+
+	template<int rank, typename F>
+	static void forEachInMemoryOrder(intN<rank> const & size, F && f) {
+		forEachIndexInBox(intN<rank>(), size, f);
+	}
+
+	// f(intN min, intN extent, intN step) for each brick, see MappedGrid::Brick
+	template<int rank, typename F>
+	static void forEachBrick(intN<rank> const & size, F && f) {
+		if (size.product()) f(intN<rank>(), size, stepForSize(size));
+	}
+};
+
+template<int brick_>
+struct GridMappingTiled {
+	static_assert(brick_ > 0);
+	static constexpr int brick = brick_;
+
+	template<int rank>
+	static intN<rank> brickCounts(intN<rank> const & size) {
+		return intN<rank>([&](int d) -> int { return (size(d) + brick - 1) / brick; });
+	}
+
+	template<int rank>
+	static constexpr int brickVolume() {
+		int n = 1;
+		for (int d = 0; d < rank; ++d) n *= brick;
+		return n;
+	}
+
+	// step of each index within a brick
+	template<int rank>
+	static intN<rank> localStep() {
+		intN<rank> result;
+		for (int d = 0, s = 1; d < rank; ++d, s *= brick) result(d) = s;
+		return result;
+	}
+
+	template<int rank>
+	static int storedCount(intN<rank> const & size) {
+		return brickCounts(size).product() * brickVolume<rank>();
+	}
+
+	template<int rank>
+	static std::vector<int> dimTable(intN<rank> const & size, int d) {
+		auto const brickStep = stepForSize(brickCounts(size));
+		int const localStep_ = localStep<rank>()(d);
+		std::vector<int> table(size(d));
+		for (int x = 0; x < size(d); ++x) {
+			table[x] = x / brick * brickStep(d) * brickVolume<rank>() + x % brick * localStep_;
+		}
+		return table;
+	}
+
+	template<int rank, typename F>
+	static void forEachInMemoryOrder(intN<rank> const & size, F && f) {
+		forEachBrick(size, [&](intN<rank> const & min, intN<rank> const & extent, intN<rank> const &) {
+			forEachIndexInBox(min, extent, f);
+		});
+	}
+
+	template<int rank, typename F>
+	static void forEachBrick(intN<rank> const & size, F && f) {
+		auto const step = localStep<rank>();
+		for (auto b : RangeObj<rank>(intN<rank>(), brickCounts(size))) {
+			auto const min = b * brick;
+			// clamp the last bricks.  they keep the full brick's steps, the rest is padding.
+			auto const extent = intN<rank>([&](int d) -> int { return std::min(brick, size(d) - min(d)); });
+			f(min, extent, step);
+		}
+	}
+};
+
+struct GridMappingMorton {
+	// bitPos[d][b] is where bit b of index d goes, for b < bits(d)
+	template<int rank>
+	struct Bits {
+		intN<rank> bits;
+		int totalBits = {};
+		std::vector<int> bitPos[rank];
+
+		Bits(intN<rank> const & size) {
+			int maxBits = 0;
+			for (int d = 0; d < rank; ++d) {
+				while ((1 << bits(d)) < size(d)) ++bits(d);
+				maxBits = std::max(maxBits, bits(d));
+			}
+			for (int b = 0; b < maxBits; ++b) {
+				for (int d = 0; d < rank; ++d) {
+					if (b < bits(d)) bitPos[d].push_back(totalBits++);
+				}
+			}
+			if (totalBits >= 31) throw Common::Exception() << "Morton padded size of " << size << " is too big";
+		}
+	};
+
+	template<int rank>
+	static int storedCount(intN<rank> const & size) {
+		return size.product() ? 1 << Bits<rank>(size).totalBits : 0;
+	}
+
+	template<int rank>
+	static std::vector<int> dimTable(intN<rank> const & size, int d) {
+		auto const bits = Bits<rank>(size);
+		std::vector<int> table(size(d));
+		for (int x = 0; x < size(d); ++x) {
+			int offset = 0;
+			for (int b = 0; b < bits.bits(d); ++b) {
+				if (x & (1 << b)) offset |= 1 << bits.bitPos[d][b];
+			}
+			table[x] = offset;
+		}
+		return table;
+	}
+
+	template<int rank, typename F>
+	static void forEachInMemoryOrder(intN<rank> const & size, F && f) {
+		if (!size.product()) return;
+		visit(size, Bits<rank>(size), 0, f);
+	}
+
+	/*
+	only the lowest bit of each index is affine, so bricks are the aligned blocks of 2 along each dim that has bits.
+	dim 0's lowest bit is always bit 0 of the offset, so rows along dim 0 are still contiguous.
+	*/
+	template<int rank, typename F>
+	static void forEachBrick(intN<rank> const & size, F && f) {
+		if (!size.product()) return;
+		auto const bits = Bits<rank>(size);
+		int maxBits = 0;
+		intN<rank> width, step;
+		for (int d = 0; d < rank; ++d) {
+			maxBits = std::max(maxBits, bits.bits(d));
+			width(d) = bits.bits(d) ? 2 : 1;
+			step(d) = bits.bits(d) ? 1 << bits.bitPos[d][0] : 0;
+		}
+		visit(size, bits, std::min(maxBits, 1), [&](intN<rank> const & min) {
+			intN<rank> extent;
+			for (int d = 0; d < rank; ++d) extent(d) = std::min(width(d), size(d) - min(d));
+			f(min, extent, step);
+		});
+	}
+
+protected:
+	/*
+	calls f(min) for each block of the bits below stopLevel, in memory order.
+	This walks the offsets of the blocks in order and flips the bits of min along with the bits of the offset,
+	which is a few bits per block on average, rather than recursing down the quadtree / octree / etc.
+	The bits below stopLevel are the lowest bits of the offset, since bitPos goes level by level.
+	*/
+	template<int rank, typename F>
+	static void visit(intN<rank> const & size, Bits<rank> const & bits, int stopLevel, F && f) {
+		// offset bit p is bit bitIndex[p] of index bitDim[p]
+		int bitDim[32] = {};
+		int bitIndex[32] = {};
+		int lowBits = 0;
+		for (int d = 0; d < rank; ++d) {
+			for (int b = 0; b < bits.bits(d); ++b) {
+				bitDim[bits.bitPos[d][b]] = d;
+				bitIndex[bits.bitPos[d][b]] = b;
+				if (b < stopLevel) ++lowBits;
+			}
+		}
+		int const end = 1 << bits.totalBits;
+		intN<rank> min;
+		for (int offset = 0; offset < end;) {
+			int out = -1;
+			for (int d = 0; d < rank; ++d) {
+				if (min(d) >= size(d)) {
+					out = d;
+					break;
+				}
+			}
+			int next;
+			if (out == -1) {
+				f(min);
+				next = offset + (1 << lowBits);
+			} else {
+				// skip the subtree entirely in the padding: every offset that keeps the bits of min(out) from its lowest set bit up
+				int const p = bits.bitPos[out][std::countr_zero((unsigned)min(out))];
+				next = ((offset >> p) + 1) << p;
+			}
+			for (int flipped = (offset ^ next) & (end - 1); flipped; flipped &= flipped - 1) {
+				int const p = std::countr_zero((unsigned)flipped);
+				min(bitDim[p]) ^= 1 << bitIndex[p];
+			}
+			offset = next;
+		}
+	}
+};
+
+template<
+	typename Type_,
+	int rank_,
+	typename Mapping_,
+	typename Allocator_ = AlignedAllocator<Type_, std::max<std::size_t>(64, alignof(Type_))>
+>
+struct MappedGrid {
+	using Type = Type_;
+	using value_type = Type;
+	static constexpr auto rank = rank_;
+	using intN = Tensor::intN<rank>;
+	using Mapping = Mapping_;
+	using Allocator = Allocator_;
+	using AllocTraits = std::allocator_traits<Allocator>;
+
+	intN size;
+	int storedCount = {};	// size.product() plus padding
+	Type * v = {};
+	std::shared_ptr<Type> buffer;
+
+	// offset of index i is the sum of tables[tableStart(d) + i(d)]
+	std::vector<int> tables;
+	intN tableStart;
+
+	[[no_unique_address]] Allocator alloc;
+
+	MappedGrid() {}
+
+	// zero-initialized
+	MappedGrid(intN const & size_, Allocator const & alloc_ = {})
+	:	size(size_),
+		alloc(alloc_)
+	{
+		buildTables();
+		allocBuffer();
+	}
+
+	MappedGrid(MappedGrid const & src)
+	:	size(src.size),
+		tables(src.tables),
+		tableStart(src.tableStart),
+		alloc(AllocTraits::select_on_container_copy_construction(src.alloc))
+	{
+		allocBuffer();
+		std::copy_n(src.v, storedCount, v);
+	}
+
+	MappedGrid(MappedGrid && src)
+	:	size(src.size),
+		storedCount(src.storedCount),
+		v(src.v),
+		buffer(std::move(src.buffer)),
+		tables(std::move(src.tables)),
+		tableStart(src.tableStart),
+		alloc(std::move(src.alloc))
+	{
+		src.v = nullptr;
+		src.storedCount = 0;
+	}
+
+	// from a linear Grid or GridView
+	template<typename SrcType>
+	requires (std::is_same_v<std::remove_const_t<SrcType>, Type>)
+	explicit MappedGrid(GridView<SrcType, rank> const & src, Allocator const & alloc_ = {})
+	: MappedGrid(src.size, alloc_) {
+		forEach([&](intN const & i, Type & x) {
+			x = src(i);
+		});
+	}
+
+	template<typename A>
+	explicit MappedGrid(Grid<Type, rank, A> const & src, Allocator const & alloc_ = {})
+	: MappedGrid(src.view(), alloc_) {}
+
+	MappedGrid & operator=(MappedGrid const & src) {
+		if (this != &src) *this = MappedGrid(src);
+		return *this;
+	}
+
+	MappedGrid & operator=(MappedGrid && src) {
+		size = src.size;
+		storedCount = src.storedCount;
+		v = src.v;
+		buffer = std::move(src.buffer);
+		tables = std::move(src.tables);
+		tableStart = src.tableStart;
+		alloc = std::move(src.alloc);
+		src.v = nullptr;
+		src.storedCount = 0;
+		return *this;
+	}
+
+	Grid<Type, rank> toGrid() const {
+		auto result = Grid<Type, rank>(size, GridNoInit());
+		forEach([&](intN const & i, Type const & x) {
+			result(i) = x;
+		});
+		return result;
+	}
+
+	int offset(intN const & i) const {
+#ifdef DEBUG
+		for (int d = 0; d < rank; ++d) {
+			if (i(d) < 0 || i(d) >= size(d)) {
+				throw Common::Exception() << "size is " << size << " but dereference is " << i;
+			}
+		}
+#endif
+		int result = 0;
+		for (int d = 0; d < rank; ++d) {
+			result += tables[tableStart(d) + i(d)];
+		}
+		return result;
+	}
+
+	Type & operator()(intN const & i) { return v[offset(i)]; }
+	Type const & operator()(intN const & i) const { return v[offset(i)]; }
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Type & operator()(Ints... is) { return (*this)(intN((int)is...)); }
+
+	template<typename... Ints>
+	requires (sizeof...(Ints) == rank && (std::is_convertible_v<Ints, int> && ...))
+	Type const & operator()(Ints... is) const { return (*this)(intN((int)is...)); }
+
+	/*
+	per-dimension offsets of the neighborhood of i, for stencils.
+	The offset of i + delta is the sum over d of result(d)(delta(d) + radius).
+	i must be at least radius from the edges.
+	*/
+	template<int radius>
+	vec<vec<int, 2 * radius + 1>, rank> neighborOffsets(intN const & i) const {
+		vec<vec<int, 2 * radius + 1>, rank> result;
+		for (int d = 0; d < rank; ++d) {
+			int const * const table = tables.data() + tableStart(d) + i(d) - radius;
+			for (int k = 0; k < 2 * radius + 1; ++k) {
+				result(d)(k) = table[k];
+			}
+		}
+		return result;
+	}
+
+	/*
+	a box of cells that are affine in memory:
+	cell min + l, for 0 <= l < extent, is at offset + l.dot(step).
+	step(0) is 1 unless extent(0) is 1, so rows along dimension 0 are contiguous.
+	The bricks only depend on the Mapping and size, so one sweep can read one grid and write another of the same size.
+	*/
+	struct Brick {
+		intN min;
+		intN extent;
+		int offset = {};
+		intN step;
+	};
+
+	// f(Brick const & b) for every brick, in memory order
+	template<typename F>
+	void forEachBrick(F && f) const {
+		Mapping::forEachBrick(size, [&](intN const & min, intN const & extent, intN const & step) {
+			f(Brick{min, extent, offset(min), step});
+		});
+	}
+
+	/*
+	stencil sweep over the cells at least radius from the edges, a run of cells at a time.
+	f(int offset, int count, vec<vec<int, 2 * radius + 1>, rank> const & delta) is called for the cells at offset, offset + 1, ..., offset + count - 1, consecutive along dimension 0.
+	The neighbor at i + dx of each of them is at its own offset plus the sum over d of delta(d)(dx(d) + radius).
+	Runs are the brick's rows without the cells within radius of its faces along dimension 0, and those cells on their own.
+	*/
+	template<int radius, typename F>
+	void forEachStencilRow(F && f) const {
+		vec<vec<int, 2 * radius + 1>, rank> delta;
+		// neighbor deltas along d of index x
+		auto tableDelta = [&](int d, int x) {
+			int const * const table = tables.data() + tableStart(d) + x;
+			for (int k = 0; k < 2 * radius + 1; ++k) {
+				delta(d)(k) = table[k - radius] - table[0];
+			}
+		};
+		forEachBrick([&](Brick const & b) {
+			intN lo, hi;
+			for (int d = 0; d < rank; ++d) {
+				lo(d) = std::max(b.min(d), radius);
+				hi(d) = std::min(b.min(d) + b.extent(d), size(d) - radius);
+				if (lo(d) >= hi(d)) return;
+			}
+			// along dimension 0, [innerLo, innerHi) have their neighbors in this brick
+			int const innerLo = std::min(std::max(lo(0), b.min(0) + radius), hi(0));
+			int const innerHi = std::max(innerLo, std::min(hi(0), b.min(0) + b.extent(0) - radius));
+			auto i = lo;
+			for (;;) {
+				// offset of (b.min(0), i(1), ...)
+				int rowOffset = b.offset;
+				for (int d = 1; d < rank; ++d) {
+					rowOffset += (i(d) - b.min(d)) * b.step(d);
+					tableDelta(d, i(d));
+				}
+				for (int x = lo(0); x < innerLo; ++x) {
+					tableDelta(0, x);
+					f(rowOffset + (x - b.min(0)) * b.step(0), 1, delta);
+				}
+				if (innerLo < innerHi) {
+					for (int k = 0; k < 2 * radius + 1; ++k) {
+						delta(0)(k) = (k - radius) * b.step(0);
+					}
+					f(rowOffset + (innerLo - b.min(0)) * b.step(0), innerHi - innerLo, delta);
+				}
+				for (int x = innerHi; x < hi(0); ++x) {
+					tableDelta(0, x);
+					f(rowOffset + (x - b.min(0)) * b.step(0), 1, delta);
+				}
+				int d = 1;
+				for (; d < rank; ++d) {
+					if (++i(d) < hi(d)) break;
+					i(d) = lo(d);
+				}
+				if (d == rank) return;
+			}
+		});
+	}
+
+	// in index order, not memory order.  see forEach.
+	RangeObj<rank> range() const {
+		return RangeObj<rank>(intN(), size);
+	}
+
+	// f(intN i, Type & x) for every cell, in memory order
+	template<typename F>
+	void forEach(F && f) {
+		Mapping::forEachInMemoryOrder(size, [&](intN const & i) {
+			f(i, (*this)(i));
+		});
+	}
+
+	template<typename F>
+	void forEach(F && f) const {
+		Mapping::forEachInMemoryOrder(size, [&](intN const & i) {
+			f(i, (*this)(i));
+		});
+	}
+
+protected:
+	void buildTables() {
+		tables.clear();
+		for (int d = 0; d < rank; ++d) {
+			tableStart(d) = (int)tables.size();
+			auto const table = Mapping::dimTable(size, d);
+			tables.insert(tables.end(), table.begin(), table.end());
+		}
+	}
+
+	void allocBuffer() {
+		storedCount = Mapping::storedCount(size);
+		buffer = allocGridBuffer(alloc, storedCount, true);
+		v = buffer.get();
+	}
+};
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Common/Exception.h"
+#include <string>
+#include <cstring>	//strerror
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define TENSOR_GRID_MMAP 1
+#endif
+
+/*
+Grids backed by memory-mapped files, for datasets bigger than RAM.
+Pages are read in as cells are touched and can be dropped by the OS under memory pressure.
+
+auto g = mapGridFile<float, 3>("snapshot.bin", int3(1024,1024,1024), GridMapMode::ReadOnly);
+returns an ordinary Grid whose buffer is the mapping, so operator(), range(), views etc work unchanged.
+The mapping is unmapped when the last Grid sharing it is destroyed.
+
+The file holds the cells in Grid's order, first index fastest, starting at byteOffset.
+Grids index with int, so to process more than 2^31 cells map one slab at a time with byteOffset.
+
+ReadOnly maps read-only, so writing to the Grid is a segfault.
+ReadWrite writes through to the file.
+Create makes or truncates the file to fit, then maps it ReadWrite.
+
+Resizing or copy-assigning a different size into a mapped Grid reallocates it on the heap, leaving the file alone.
+*/
+
+namespace Tensor {
+
+enum class GridMapMode { ReadOnly, ReadWrite, Create };
+
+enum class GridMapAdvice { Normal, Sequential, Random, WillNeed, DontNeed };
+
+#if TENSOR_GRID_MMAP
+/*
+the madvise flag, or -1 to skip the hint.
+Linux's MADV_DONTNEED zero-fills private and anonymous pages, i.e. heap Grids, so DontNeed is MADV_PAGEOUT there,
+which reclaims the pages but keeps their contents, writing them back to the file or to swap.
+Linux without MADV_PAGEOUT (before 5.4) skips it.  Elsewhere MADV_DONTNEED is only a hint.
+*/
+inline int gridMapAdviceFlag(GridMapAdvice advice) {
+	switch (advice) {
+	case GridMapAdvice::Sequential: return MADV_SEQUENTIAL;
+	case GridMapAdvice::Random: return MADV_RANDOM;
+	case GridMapAdvice::WillNeed: return MADV_WILLNEED;
+	case GridMapAdvice::DontNeed:
+#if defined(MADV_PAGEOUT)
+		return MADV_PAGEOUT;
+#elif defined(__linux__)
+		return -1;
+#else
+		return MADV_DONTNEED;
+#endif
+	default: return MADV_NORMAL;
+	}
+}
+#endif
+
+template<typename Type, int rank>
+Grid<Type, rank> mapGridFile(
+	std::string const & filename,
+	intN<rank> const & size,
+	GridMapMode mode = GridMapMode::ReadOnly,
+	std::uint64_t byteOffset = 0,
+	GridMapAdvice advice = GridMapAdvice::Normal
+) {
+	static_assert(std::is_trivially_copyable_v<Type>, "mapped Types are read and written as raw bytes");
+#if TENSOR_GRID_MMAP
+	std::uint64_t numCells = 1;
+	for (int i = 0; i < rank; ++i) {
+		if (size(i) < 0) throw Common::Exception() << "mapGridFile size " << size << " is negative";
+		numCells *= size(i);
+	}
+	if (numCells > (std::uint64_t)std::numeric_limits<int>::max()) {
+		throw Common::Exception() << "mapGridFile size " << size << " has more cells than Grid can index, map it in slabs";
+	}
+	if (byteOffset % alignof(Type)) {
+		throw Common::Exception() << "mapGridFile offset " << byteOffset << " isn't aligned to " << alignof(Type);
+	}
+	std::uint64_t const numBytes = numCells * sizeof(Type);
+
+	int const fd = ::open(
+		filename.c_str(),
+		mode == GridMapMode::ReadOnly ? O_RDONLY : (mode == GridMapMode::ReadWrite ? O_RDWR : (O_RDWR | O_CREAT | O_TRUNC)),
+		0644
+	);
+	if (fd < 0) throw Common::Exception() << "failed to open " << filename << ": " << std::strerror(errno);
+	// the mapping stays valid after the fd is closed
+	struct FdCloser { int fd; ~FdCloser() { ::close(fd); } } closer{fd};
+
+	if (mode == GridMapMode::Create) {
+		if (::ftruncate(fd, (off_t)(byteOffset + numBytes)) != 0) {
+			throw Common::Exception() << "failed to resize " << filename << ": " << std::strerror(errno);
+		}
+	} else {
+		struct stat st;
+		if (::fstat(fd, &st) != 0) throw Common::Exception() << "failed to stat " << filename << ": " << std::strerror(errno);
+		if ((std::uint64_t)st.st_size < byteOffset + numBytes) {
+			throw Common::Exception() << filename << " is " << st.st_size << " bytes but size " << size << " at offset " << byteOffset << " needs " << (byteOffset + numBytes);
+		}
+	}
+
+	Grid<Type, rank> result;
+	result.size = size;
+	result.step = stepForSize(size);
+	if (!numBytes) return result;
+
+	// mmap offsets must be page-aligned
+	std::uint64_t const pageSize = (std::uint64_t)::sysconf(_SC_PAGESIZE);
+	std::uint64_t const mapOffset = byteOffset / pageSize * pageSize;
+	std::size_t const mapBytes = (std::size_t)(byteOffset - mapOffset + numBytes);
+	void * const p = ::mmap(
+		nullptr,
+		mapBytes,
+		mode == GridMapMode::ReadOnly ? PROT_READ : (PROT_READ | PROT_WRITE),
+		MAP_SHARED,
+		fd,
+		(off_t)mapOffset
+	);
+	if (p == MAP_FAILED) throw Common::Exception() << "failed to map " << filename << ": " << std::strerror(errno);
+	if (advice != GridMapAdvice::Normal && gridMapAdviceFlag(advice) >= 0) {
+		::madvise(p, mapBytes, gridMapAdviceFlag(advice));	// only a hint, ignore failure
+	}
+
+	result.v = (Type*)((char*)p + (byteOffset - mapOffset));
+	// aliasing ctor: owns the mapping, points at the first cell
+	result.buffer = std::shared_ptr<Type>(
+		std::shared_ptr<void>(p, [mapBytes](void * p) { ::munmap(p, mapBytes); }),
+		result.v
+	);
+	// capacity stays 0 so resize() and copyFrom() of other sizes never reuse the mapping
+	return result;
+#else
+	throw Common::Exception() << "mapGridFile isn't supported on this platform";
+#endif
+}
+
+/*
+change the paging hint of the pages under a view, i.e. Sequential before a full sweep, Random before sparse lookups, DontNeed after finishing a slab.
+Works for heap Grids as well.
+madvise works on whole pages, so the hint also covers whatever shares the view's first and last pages.
+None of the hints lose data, see gridMapAdviceFlag, so that only costs performance.
+*/
+template<typename Type, int rank>
+void adviseGrid(GridView<Type, rank> const & view, GridMapAdvice advice) {
+#if TENSOR_GRID_MMAP
+	if (!view.size.product()) return;
+	int const flag = gridMapAdviceFlag(advice);
+	if (flag < 0) return;
+	std::uintptr_t begin = (std::uintptr_t)view.v;
+	std::uintptr_t end = begin;
+	for (int i = 0; i < rank; ++i) end += (std::uintptr_t)(view.size(i) - 1) * view.step(i) * sizeof(Type);
+	end += sizeof(Type);
+	// madvise needs a page-aligned start
+	std::uintptr_t const pageSize = (std::uintptr_t)::sysconf(_SC_PAGESIZE);
+	begin = begin / pageSize * pageSize;
+	::madvise((void*)begin, end - begin, flag);	// only a hint, ignore failure
+#endif
+}
+
+template<typename Type, int rank, typename Allocator>
+void adviseGrid(Grid<Type, rank, Allocator> & grid, GridMapAdvice advice) {
+	adviseGrid(grid.view(), advice);
+}
+
+// flush a ReadWrite mapping's changes to the file
+template<typename Type, int rank, typename Allocator>
+void syncGrid(Grid<Type, rank, Allocator> & grid) {
+#if TENSOR_GRID_MMAP
+	if (!grid.size.product()) return;
+	std::uintptr_t const pageSize = (std::uintptr_t)::sysconf(_SC_PAGESIZE);
+	std::uintptr_t const begin = (std::uintptr_t)grid.v / pageSize * pageSize;
+	std::uintptr_t const end = (std::uintptr_t)(grid.v + grid.size.product());
+	if (::msync((void*)begin, end - begin, MS_SYNC) != 0) {
+		throw Common::Exception() << "failed to sync grid: " << std::strerror(errno);
+	}
+#endif
+}
+
+}
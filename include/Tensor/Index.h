@@ -2,12 +2,17 @@
 
 #include "Tensor/Vector.h.h"
 #include "Tensor/Index.h.h"
+#include "Tensor/Range.h"	//RangeObj
 #include "Common/Exception.h"
 #include "Common/Tuple.h"	//TupleForEach
 #include "Common/Meta.h"
 #include <tuple>
 #include <functional>	// plus minus binary_operator etc
 #include <utility>			//integer_sequence
+#include <array>
+#include <bit>		//countr_zero
+#include <cstdint>
+#include <string>
 
 /*
 Ok here's a dilemma ... a_i = b_ijk^jk_lm^lm * c_npq^npq
@@ -91,6 +96,14 @@ struct GetTensorIthDim {
 	};
 };
 
+// integer_sequence<int, ...> to std::array<int, ...>
+template<typename Seq>
+constexpr auto seqToArray() {
+	return []<int ... is>(std::integer_sequence<int, is...>) constexpr {
+		return std::array<int, sizeof...(is)>{is...};
+	}(Seq{});
+}
+
 // used for picking out the summation indexes, used both by IndexAccess and by determining in tensors if the trace produces a scalar or not
 template<typename T>
 struct GetIthTupleSecond {
@@ -104,8 +117,24 @@ struct GetIthTupleSecond {
 
 struct IndexBase {};
 
-template<char ident>
-struct Index : public IndexBase {};
+/*
+Index<ident, offset, size> spans [offset, offset+size) of the dimension it indexes.
+size = 0 means up to the end of the dimension.
+Indexes are matched by their ident alone, so with Index<'i'> i and Index<'i',1> i1 ,
+K(i,j) = g4(i1,j1) reads the spatial 3x3 block of a 4x4 g4 in place, and g4(i1,j1) = K(i,j) writes it.
+*/
+template<char ident_, int offset_, int size_>
+struct Index : public IndexBase {
+	static_assert(offset_ >= 0 && size_ >= 0);
+	static constexpr char ident = ident_;
+	static constexpr int offset = offset_;
+	static constexpr int size = size_;
+	// the same index over the whole dimension, used for matching indexes
+	using Full = Index<ident>;
+};
+
+template<typename T>
+using GetIndexFull = typename T::Full;
 
 template<typename T>
 constexpr bool is_IndexExpr_v = requires(T const & t) { &T::isIndexExprFlag; };
@@ -116,8 +145,8 @@ concept IsMatchingRankExpr =
 	&& is_IndexExpr_v<B>
 	&& A::rank == B::rank;
 
-template<char ch>
-std::ostream & operator<<(std::ostream & o, Index<ch> const & i) {
+template<char ch, int offset, int size>
+std::ostream & operator<<(std::ostream & o, Index<ch, offset, size> const & i) {
 	return o << ch;
 }
 
@@ -262,7 +291,33 @@ struct HasMoreThanOneIndex {
 // here's the helper with all the info that IndexAccess and its invokers will need:
 template<typename IndexTuple_>
 struct IndexAccessDetails {
-	using IndexTuple = IndexTuple_;
+	// indexes without their ranges, since they are matched by ident
+	using IndexTuple = Common::TupleTypeMap<IndexTuple_, GetIndexFull>;
+
+	// ranges of each location in IndexTuple_
+	static constexpr auto offsets = []<typename... Is>(std::tuple<Is...> *) constexpr {
+		return std::array<int, sizeof...(Is)>{Is::offset...};
+	}((IndexTuple_*)nullptr);
+	static constexpr auto sizes = []<typename... Is>(std::tuple<Is...> *) constexpr {
+		return std::array<int, sizeof...(Is)>{Is::size...};
+	}((IndexTuple_*)nullptr);
+	static constexpr bool hasRanges = []() constexpr {
+		for (int k = 0; k < (int)offsets.size(); ++k) {
+			if (offsets[k] || sizes[k]) return true;
+		}
+		return false;
+	}();
+
+	// dims of each location in IndexTuple_ after applying ranges to the dims of T
+	template<typename T>
+	static constexpr auto getLocDims() {
+		auto result = seqToArray<typename T::dimseq>();
+		for (int k = 0; k < (int)result.size(); ++k) {
+			if (offsets[k] + sizes[k] > result[k]) throw Common::Exception() << "index range is out of bounds";
+			result[k] = sizes[k] ? sizes[k] : result[k] - offsets[k];
+		}
+		return result;
+	}
 
 	/*
 	TODO HERE before rank is established,
@@ -300,6 +355,77 @@ struct IndexAccessDetails {
 	static constexpr int rank = AssignIndexSeq::size();
 };
 
+/*
+sum t over the location pairs of SumIndexSeq, starting from the index 'j' whose other locations are already set.
+locDims and offsets are the range of each location.
+*/
+template<typename SumIndexSeq, typename T, std::size_t n>
+auto sumRangedTraces(
+	T const & t,
+	typename T::intN j,
+	std::array<int, n> const & locDims,
+	std::array<int, n> const & offsets
+) {
+	constexpr auto sumLocs = seqToArray<SumIndexSeq>();	// pairs of locations
+	constexpr int numSums = sumLocs.size() / 2;
+	std::array<int, numSums> k = {};
+	typename T::Scalar sum = {};
+	for (;;) {
+		for (int s = 0; s < numSums; ++s) {
+			j[sumLocs[2*s]] = k[s] + offsets[sumLocs[2*s]];
+			j[sumLocs[2*s+1]] = k[s] + offsets[sumLocs[2*s+1]];
+		}
+		sum += t(j);
+		int s = 0;
+		for (; s < numSums; ++s) {
+			if (++k[s] < locDims[sumLocs[2*s]]) break;
+			k[s] = 0;
+		}
+		if (s == numSums) break;
+	}
+	return sum;
+}
+
+// traces of a tensor indexed by IndexTuple with all its indexes summed
+template<typename IndexTuple, typename T>
+auto applyIndexTraces(T & t) {
+	using Details = IndexAccessDetails<IndexTuple>;
+	if constexpr (!Details::hasRanges) {
+		return applyTraces<typename Details::SumIndexSeq>(t);
+	} else {
+		constexpr auto locDims = Details::template getLocDims<std::remove_cv_t<T>>();
+		return sumRangedTraces<typename Details::SumIndexSeq>(t, typename T::intN(), locDims, Details::offsets);
+	}
+}
+
+/*
+the tensor type to assign an expression into.
+destseq is the location of each destination index within the expression's AssignIndexTuple.
+expressions that know their own storage (IndexAccess, TensorMulExpr) keep it,
+as long as the indexes are not reordered, or as long as all of the indexes are in one (symmetric or antisymmetric) storage, since any permutation of those produces the same storage.
+all others are expanded.
+*/
+template<typename Expr, typename destseq>
+struct ExprAssignTypeImpl {
+	using type = tensorScalarSeq<
+		typename Expr::Scalar,
+		Common::SeqToSeqMap<destseq, GetSeqIth<typename Expr::dimseq>::template go>
+	>;
+};
+template<typename Expr, typename destseq>
+requires (
+	requires { typename Expr::OutputTensorType; }
+	&& (
+		std::is_same_v<destseq, std::make_integer_sequence<int, destseq::size()>>
+		|| Expr::OutputTensorType::numNestings == 1
+	)
+)
+struct ExprAssignTypeImpl<Expr, destseq> {
+	using type = typename Expr::OutputTensorType;
+};
+template<typename Expr, typename destseq>
+using ExprAssignType = typename ExprAssignTypeImpl<Expr, destseq>::type;
+
 //shorthand if you don't want to declare your lhs first and dereference it first ...
 // zero assign-indexes should have been handled in tensor's operator()
 //  and shouldn't be possible here
@@ -333,8 +459,7 @@ struct IndexAccessDetails {
 	constexpr decltype(auto) assign(IndexType, IndexTypes...) const {\
 		using DstAssignIndexTuple = std::tuple<IndexType, IndexTypes...>;\
 		using destseq = Common::TupleToSeqMap<int, DstAssignIndexTuple, FindInAssignIndexTuple<AssignIndexTuple>::template go>;\
-		using dims = Common::SeqToSeqMap<destseq, GetSeqIth<dimseq>::template go>;\
-		using R = tensorScalarSeq<Scalar, dims>;\
+		using R = ExprAssignType<This, destseq>;\
 		return AssignImpl<R, IndexType, IndexTypes...>::exec(*this);\
 	}\
 \
@@ -343,24 +468,98 @@ struct IndexAccessDetails {
 		using DstAssignIndexTuple = AssignIndexTuple;\
 		using destseq = Common::TupleToSeqMap<int, DstAssignIndexTuple, FindInAssignIndexTuple<AssignIndexTuple>::template go>;\
 		static_assert(std::is_same_v<destseq, std::make_integer_sequence<int, destseq::size()>>);\
-		using dims = Common::SeqToSeqMap<destseq, GetSeqIth<dimseq>::template go>;\
-		using R = tensorScalarSeq<Scalar, dims>;\
+		using R = ExprAssignType<This, destseq>;\
 		return Common::tuple_apply_t<AssignImpl, Common::tuple_cat_t<std::tuple<R>, DstAssignIndexTuple>>::exec(*this);\
 	}
 
 
+// true if the memory ranges [aBegin, aEnd) and [bBegin, bEnd) overlap
+inline bool memoryOverlaps(void const * aBegin, void const * aEnd, void const * bBegin, void const * bEnd) {
+	return std::less<void const *>()(aBegin, bEnd) && std::less<void const *>()(bBegin, aEnd);
+}
+
+/*
+common subexpression elimination within one assignment.
+Before an expression is read, its cached nodes (products, and traces that aren't lazy-eval) register themselves with shareSubexprs().
+A node that is structurally the same as one already registered reads from the first one's cache instead of computing its own.
+Structurally the same is: same node type (so same indexes and same operand types), and sameExpr() -- same source tensor addresses, same scalars.
+The links only last as long as the registry, i.e. the one assignment, since after that the sources can change and the first node can be destroyed.
+Past maxNodes, nodes are just not shared.
+*/
+struct SubexprRegistry {
+	static constexpr int maxNodes = 32;
+	std::array<std::pair<void const *, void const *>, maxNodes> nodes;	// {type key, node}, uninitialized past numNodes
+	int numNodes = {};
+	std::array<std::pair<void const *, void (*)(void const *)>, maxNodes> links;	// {node, clear its 'shared'}, uninitialized past numLinks
+	int numLinks = {};
+
+	SubexprRegistry() {}
+	SubexprRegistry(SubexprRegistry const &) = delete;
+	SubexprRegistry & operator=(SubexprRegistry const &) = delete;
+
+	~SubexprRegistry() {
+		for (int n = 0; n < numLinks; ++n) {
+			links[n].second(links[n].first);
+		}
+	}
+
+	template<typename T>
+	static void const * typeKey() {
+		static constexpr char key = {};
+		return &key;
+	}
+
+	// returns the first registered node that is the same as 'node', or registers 'node' and returns it
+	template<typename T>
+	T const * find(T const & node) {
+		for (int n = 0; n < numNodes; ++n) {
+			if (nodes[n].first == typeKey<T>()) {
+				auto const other = (T const *)nodes[n].second;
+				if (other->sameExpr(node)) return other;
+			}
+		}
+		if (numNodes < maxNodes) nodes[numNodes++] = {typeKey<T>(), &node};
+		return &node;
+	}
+
+	// have 'node' read from 'first' until the registry is destroyed
+	template<typename T>
+	void link(T const & node, T const * first) {
+		if (numLinks == maxNodes) return;
+		node.shared = first;
+		links[numLinks++] = {&node, [](void const * p) {
+			((T const *)p)->shared = {};
+		}};
+	}
+};
+
 /*
 rather than this matching a Tensor for index dereferencing,
 this needs its index access abstracted so that binary operations can provide their own as well
 
 TODO instead of .assign() how about just give IndexAccess its own operator()(IndexBase...), and have that produce a tensor.
 */
-template<typename InputTensorType_, typename IndexTuple_>
+
+/*
+trace evaluation policies for IndexAccess:
+IndexEvalCache = traces are computed upon first read and stored.
+IndexEvalLazy = store a reference to the tensor and sum the traced indexes upon each read.
+	Better when only a few elements are read, or when the result is read once per element anyways.
+IndexEvalAuto = pick one using the cost model in IndexAccess.
+Select one with tensor's .indexEval<Policy>(i,j,...), otherwise IndexEvalAuto is used.
+IndexAccess's without traces are always lazy.
+*/
+struct IndexEvalAuto {};
+struct IndexEvalCache {};
+struct IndexEvalLazy {};
+
+template<typename InputTensorType_, typename IndexTuple_, typename EvalPolicy_>
 requires is_tensor_v<InputTensorType_>
 struct IndexAccess {
 	static constexpr bool isIndexExprFlag = {};
 	using This = IndexAccess;
 	using InputTensorType = InputTensorType_;
+	using EvalPolicy = EvalPolicy_;
 
 	// std::tuple<Index<char>... >
 	// this is the input indexes wrapping the tensor, like a(i,j,k ...)
@@ -372,16 +571,40 @@ struct IndexAccess {
 	using AssignIndexSeq = typename Details::AssignIndexSeq;
 	using AssignIndexTuple = typename Details::AssignIndexTuple;
 
+	// sub-block ranges of the indexes, see Index
+	static constexpr bool hasRanges = Details::hasRanges;
+	static constexpr auto locDims = Details::template getLocDims<std::remove_cv_t<InputTensorType>>();
+	struct GetLocDim {
+		template<int i>
+		struct go {
+			static constexpr int value = locDims[i];
+		};
+	};
+
 	//"dimseq" is the dimensions associated with the assignment-indexes 
-	using dimseq = Common::SeqToSeqMap<AssignIndexSeq, GetTensorIthDim<InputTensorType>::template go>;
+	using dimseq = Common::SeqToSeqMap<AssignIndexSeq, GetLocDim::template go>;
 	
 	// based on InputTensorType as well:
 	using Scalar = typename InputTensorType::Scalar;
 
-	// TODO if instead of picking out dims then rebuilding tensor with them,
-	//  if instead you remove dims one-by-one from the source type (and add a transpose-type template for preserving symmetry and antisymmetric)
-	//  then maybe this could be optimized
-	using OutputTensorType = tensorScalarSeq<Scalar, dimseq>;
+	static_assert([]() constexpr {
+		constexpr auto sumLocs = seqToArray<SumIndexSeq>();
+		for (int k = 0; k < (int)sumLocs.size(); k += 2) {
+			if (locDims[sumLocs[k]] != locDims[sumLocs[k+1]]) return false;
+		}
+		return true;
+	}(), "summed indexes must span the same size");
+
+	// remove the summed indexes from the source type, so that any symmetry of the remaining indexes is preserved
+	// the remaining indexes are in the same order as AssignIndexTuple
+	// sub-blocks are dense
+	using OutputTensorType = std::conditional_t<
+		hasRanges,
+		tensorScalarSeq<Scalar, dimseq>,
+		typename std::remove_cv_t<InputTensorType>::template RemoveIndexSeq<SumIndexSeq>
+	>;
+	STATIC_ASSERT_EQ(OutputTensorType::rank, Details::rank);
+	static_assert(std::is_same_v<typename OutputTensorType::dimseq, dimseq>);
 
 	STATIC_ASSERT_EQ(InputTensorType::rank, (std::tuple_size_v<IndexTuple>));
 	static constexpr int rank = Details::rank;
@@ -394,27 +617,61 @@ struct IndexAccess {
 	// if we're using lazy-eval then just store a reference
 	// if we're not then store a tensor ... after traces have been computed
 	struct StorageLazy {
-		// If storageLazy is used then assert ...
-		static_assert(std::is_same_v<typename InputTensorType::template ExpandAllIndexes<>, OutputTensorType>);
 		using type = InputTensorType &;
 		static type process(InputTensorType & x) { return x; }
 	};
-	// if it's trace or * then evaluate up front
+	// if it's a cached trace then evaluate upon the first read
+	// (rather than upon construction, so common subexpressions can share one evaluation)
 	struct StorageEval {
-		using type = OutputTensorType;
-		static type process(InputTensorType & x) {
-			auto trs = applyTraces<SumIndexSeq>(x);
-			// NOTICE here I'm making an assertion that AssignIndexSeq is matching the indexes when the sum-indexes are all removed.
-			// if it's wrong then ranks (and dims) won't match
-			STATIC_ASSERT_EQ(trs.rank, type::rank);
-			return (type)trs;
-		}
+		struct type {
+			InputTensorType & src;
+			mutable OutputTensorType cache = {};
+			mutable bool evaluated = false;
+			mutable type const * shared = {};	// set by shareSubexprs for the length of one assignment
+
+			OutputTensorType const & get() const {
+				if (shared) return shared->get();
+				if (!evaluated) {
+					auto trs = applyTraces<SumIndexSeq>(src);
+					// NOTICE here I'm making an assertion that AssignIndexSeq is matching the indexes when the sum-indexes are all removed.
+					// if it's wrong then ranks (and dims) won't match
+					STATIC_ASSERT_EQ(trs.rank, OutputTensorType::rank);
+					cache = (OutputTensorType)trs;
+					evaluated = true;
+				}
+				return cache;
+			}
+		};
+		static type process(InputTensorType & x) { return type{x}; }
 	};
 
 	// to cache the tensor in the expression-tree, or to lazy-eval?
-	//  for traces, cache upon ctor and use the cache in read. (also in TensorMulExpr, cache)
-	//  for others, store the reference, and eval in read.
-	static constexpr bool useLazyEval = SumIndexSeq::size() == 0;
+	//  for no traces, store the reference, and eval in read.
+	//  for traces, it depends on EvalPolicy.
+	//  for sub-blocks, always lazy-eval.
+	//  (TensorMulExpr always caches)
+	/*
+	cost model for IndexEvalAuto, counting reads of the source tensor and assuming every element of the result is read once:
+		lazy = (expanded count of the result) * (number of summed elements per result element)
+		cache = (stored count of the result) * (number of summed elements per result element) + (expanded count of the result)
+	so lazy wins unless the result storage is smaller than its expanded form, i.e. sym or asym, and the traces are big enough to make up for it.
+	*/
+	static constexpr int sumCount = []() constexpr {
+		constexpr auto sumLocs = seqToArray<SumIndexSeq>();
+		int result = 1;
+		for (int k = 0; k < (int)sumLocs.size(); k += 2) {
+			result *= locDims[sumLocs[k]];
+		}
+		return result;
+	}();
+	static constexpr int expandedCount = Common::seq_multiplies(dimseq());
+	static constexpr int lazyCost = expandedCount * sumCount;
+	static constexpr int cacheCost = OutputTensorType::totalCount * sumCount + expandedCount;
+	static constexpr bool useLazyEval = 
+		SumIndexSeq::size() == 0
+		|| hasRanges
+		|| std::is_same_v<EvalPolicy, IndexEvalLazy>
+		|| (std::is_same_v<EvalPolicy, IndexEvalAuto> && lazyCost <= cacheCost);
 	using StorageDetails = 
 		std::conditional_t<
 			useLazyEval,
@@ -431,6 +688,53 @@ struct IndexAccess {
 
 	IndexAccess(InputTensorType & t_) : t(StorageDetails::process(t_)) {}
 
+	// copy the reference, don't assign through it.  expression nodes keep their operands by copy.
+	IndexAccess(This const & o) : t(o.t) {}
+	IndexAccess(This && o) : t(o.t) {}
+
+	// the source tensor
+	InputTensorType & source() const {
+		if constexpr (useLazyEval) {
+			return t;
+		} else {
+			return t.src;
+		}
+	}
+
+	// the tensor that read() indexes: the source if lazy-eval, the traced result if cached
+	decltype(auto) tensor() const {
+		if constexpr (useLazyEval) {
+			return source();
+		} else {
+			return t.get();
+		}
+	}
+
+	bool sameExpr(This const & o) const {
+		return &source() == &o.source();
+	}
+	void shareSubexprs(SubexprRegistry & reg) const {
+		if constexpr (!useLazyEval) {
+			auto const first = reg.find(*this);
+			if (first != this) reg.link(t, &first->t);
+		}
+	}
+
+	/*
+	alias analysis:
+	mayAlias is false at compile-time if the expression cannot reference another tensor's memory,
+	otherwise aliases() checks at runtime whether it references any memory in [begin, end).
+	lazy-eval IndexAccess's hold a reference to their tensor, cached ones read it all upon their first read, before anything is written.
+	*/
+	static constexpr bool mayAlias = useLazyEval;
+	bool aliases(void const * begin, void const * end) const {
+		if constexpr (mayAlias) {
+			return memoryOverlaps(&t, &t + 1, begin, end);
+		} else {
+			return false;
+		}
+	}
+
 	template<typename B>
 	requires is_IndexExpr_v<B>
 	IndexAccess(B const & src) {
@@ -500,24 +804,58 @@ struct IndexAccess {
 		static_assert(std::is_same_v<AssignIndexSeq, std::make_integer_sequence<int, std::tuple_size_v<IndexTuple>>>);
 		static_assert(rank == std::tuple_size_v<IndexTuple>);
 		// and its assign indexes should equal its total indexes
-		static_assert(std::is_same_v<AssignIndexTuple, IndexTuple>);
-
-		//assign using write iterator so the result will be pushed on stack before overwriting the write tensor
-		// this way we get a copy to buffer changes between read and write, in case the same tensor is used for both
-#if 0
-		// same as TENSOR_ADD_CTOR_FOR_GENERIC_TENSORS
-		// downside is it can invalidate itself if you're reading and writing to the same tensor
-		auto w = t.write();
-		for (auto i = w.begin(); i != w.end(); ++i) {
-			*i = src.template read<AssignIndexTuple>(i.readIndex);
-		};
-#else	// requires an extra object on the stack but can read and write to the same tensor
-		// OutputTensorType is expanded, for the sake of caching mid-expression 
-		// so just use InputTensorType, that's what wraps the lhs tensor: a(i,j) = b(j,i) , InputTensorType is decltype(a)
-		t = InputTensorType([&](intN i) -> Scalar {
-			return src.template read<AssignIndexTuple, dimseq>(i);
-		});
-#endif
+		static_assert(std::is_same_v<AssignIndexTuple, typename Details::IndexTuple>);
+
+		// repeated subexpressions of src share one evaluation until reg goes out of scope at the end of this assignment
+		SubexprRegistry reg;
+		src.shareSubexprs(reg);
+
+		// if the source doesn't read from our tensor then write in-place
+		if constexpr (!B::mayAlias) {
+			doAssignInPlace(src);
+		} else {
+			if (!src.aliases(&t, &t + 1)) {
+				doAssignInPlace(src);
+			} else if constexpr (hasRanges) {
+				// same as below but only the sub-block
+				auto const buffer = tensorScalarSeq<Scalar, dimseq>([&](intN i) -> Scalar {
+					return src.template read<AssignIndexTuple, dimseq>(i);
+				});
+				for (auto i : RangeObj<rank, false>(intN(), intN(dimseq()))) {
+					t(i + offsetN()) = buffer(i);
+				}
+			} else {
+				//assign using write iterator so the result will be pushed on stack before overwriting the write tensor
+				// this way we get a copy to buffer changes between read and write, in case the same tensor is used for both
+				// requires an extra object on the stack but can read and write to the same tensor
+				// the lhs has no sums so OutputTensorType is InputTensorType, that's what wraps the lhs tensor: a(i,j) = b(j,i) , InputTensorType is decltype(a)
+				t = InputTensorType([&](intN i) -> Scalar {
+					return src.template read<AssignIndexTuple, dimseq>(i);
+				});
+			}
+		}
+	}
+
+	// same as TENSOR_ADD_CTOR_FOR_GENERIC_TENSORS
+	// downside is it can invalidate itself if you're reading and writing to the same tensor, so only use this if src doesn't alias t
+	template<typename B>
+	void doAssignInPlace(B const & src) {
+		if constexpr (hasRanges) {
+			// only loop over the sub-block
+			for (auto i : RangeObj<rank, false>(intN(), intN(dimseq()))) {
+				t(i + offsetN()) = src.template read<AssignIndexTuple, dimseq>(i);
+			}
+		} else {
+			auto w = t.write();
+			for (auto i = w.begin(); i != w.end(); ++i) {
+				*i = src.template read<AssignIndexTuple, dimseq>(i.readIndex);
+			}
+		}
+	}
+
+	// offsets of the lhs sub-block, only used when there are no sums
+	static constexpr intN offsetN() {
+		return intN([](int k) -> int { return Details::offsets[k]; });
 	}
 
 	// a(j,i) = b(i,j)
@@ -535,19 +873,36 @@ struct IndexAccess {
 		static_assert(std::is_same_v<CheckDimSeq, DstDimSeq>);
 
 		using srcseq = Common::TupleToSeqMap<int, AssignIndexTuple, FindInAssignIndexTuple<DstAssignIndexTuple>::template go>;
-		return [&]<int ... j>(std::integer_sequence<int, j...>) constexpr {
-			return t(
-				(i(
-					Common::seq_get_v<j, srcseq>
-				))...
-			);
-		}(std::make_integer_sequence<int, rank>{});
+		if constexpr (useLazyEval && SumIndexSeq::size() > 0) {
+			return readLazyTrace(intN([&](int j) -> int {
+				return i(seqToArray<srcseq>()[j]);
+			}));
+		} else {
+			return [&]<int ... j>(std::integer_sequence<int, j...>) constexpr {
+				return tensor()(
+					(i(
+						Common::seq_get_v<j, srcseq>
+					) + Details::offsets[j])...
+				);
+			}(std::make_integer_sequence<int, rank>{});
+		}
+	}
+
+	// for lazy-eval traces, sum the traced indexes of the source tensor
+	// 'i' is in the order of AssignIndexTuple
+	Scalar readLazyTrace(intN const & i) const {
+		constexpr auto assignLocs = seqToArray<AssignIndexSeq>();
+		typename std::remove_cv_t<InputTensorType>::intN j;
+		for (int k = 0; k < rank; ++k) {
+			j[assignLocs[k]] = i[k] + Details::offsets[assignLocs[k]];
+		}
+		return sumRangedTraces<SumIndexSeq>(t, j, locDims, Details::offsets);
 	}
 };
 
-template<typename T, typename Is>
-std::ostream & operator<<(std::ostream & o, IndexAccess<T,Is> const & ti) {
-	o << "[" << ti.t << "_";
+template<typename T, typename Is, typename P>
+std::ostream & operator<<(std::ostream & o, IndexAccess<T,Is,P> const & ti) {
+	o << "[" << ti.tensor() << "_";
 	Common::TupleForEach(Is(), [&o](auto x, size_t i) constexpr -> bool {
 		o << x;
 		return false;
@@ -604,10 +959,24 @@ struct TensorTensorExpr##name {\
 	using Scalar = decltype(typename A::Scalar() op typename B::Scalar());\
 	TENSOR_EXPR_ADD_ASSIGNR()\
 	\
-	A const & a;\
-	B const & b;\
+	/* operands are held by value, so an expression can outlive the full-expression that built it */\
+	A a;\
+	B b;\
 	\
 	TensorTensorExpr##name(A const & a_, B const & b_) : a(a_), b(b_) {}\
+\
+	static constexpr bool mayAlias = A::mayAlias || B::mayAlias;\
+	bool aliases(void const * begin, void const * end) const {\
+		return a.aliases(begin, end) || b.aliases(begin, end);\
+	}\
+\
+	bool sameExpr(This const & o) const {\
+		return a.sameExpr(o.a) && b.sameExpr(o.b);\
+	}\
+	void shareSubexprs(SubexprRegistry & reg) const {\
+		a.shareSubexprs(reg);\
+		b.shareSubexprs(reg);\
+	}\
 \
 	template<typename DstIndexTuple, typename DstDimSeq>\
 	constexpr Scalar read(intN const & i) const {\
@@ -645,79 +1014,419 @@ TENSOR_TENSOR_EXPR_OP(Modulus,%)
 // tensor * tensor
 // this is going to cache a temp result since otherwise there risks deferred expressions to expand too many ops
 
-#if 1
-template<typename A, typename B>
-requires (
-	is_IndexExpr_v<A>
-	&& is_IndexExpr_v<B>
-)
+/*
+fused contraction of a and b
+rather than building outer(a,b) (whose size is the product of both) and then tracing it down,
+this loops over the summed indexes and accumulates directly into each output element.
+memory is proportional to the output, operations are proportional to the true contraction cost.
+
+IndexTuple is the concat of a's and b's AssignIndexTuple's
+R is the output tensor type, or the Scalar if everything is contracted.
+*/
+template<typename IndexTuple, typename R, typename TA, typename TB>
+R contractFused(TA const & a, TB const & b) {
+	using Details = IndexAccessDetails<IndexTuple>;
+	constexpr int rankA = TA::rank;
+	constexpr int rankB = TB::rank;
+	constexpr int numIndexes = rankA + rankB;
+	STATIC_ASSERT_EQ(numIndexes, (std::tuple_size_v<IndexTuple>));
+	using inputDims = Common::seq_cat_t<int, typename TA::dimseq, typename TB::dimseq>;
+	constexpr auto dims = seqToArray<inputDims>();
+	constexpr auto assignLocs = seqToArray<typename Details::AssignIndexSeq>();
+	constexpr auto sumLocs = seqToArray<typename Details::SumIndexSeq>();	// pairs of locations
+	constexpr int numSums = sumLocs.size() / 2;
+	
+	// for each input index, which output index or which summed index it is read from
+	constexpr auto srcForIndex = [&]() constexpr {
+		std::array<int, numIndexes> result = {};
+		for (int k = 0; k < (int)assignLocs.size(); ++k) {
+			result[assignLocs[k]] = k;
+		}
+		for (int k = 0; k < numSums; ++k) {
+			result[sumLocs[2*k]] = -1-k;
+			result[sumLocs[2*k+1]] = -1-k;
+		}
+		return result;
+	}();
+	constexpr auto sumDims = [&]() constexpr {
+		std::array<int, numSums> result = {};
+		for (int k = 0; k < numSums; ++k) {
+			result[k] = dims[sumLocs[2*k]];
+		}
+		return result;
+	}();
+	static_assert([&]() constexpr {
+		for (int k = 0; k < numSums; ++k) {
+			if (dims[sumLocs[2*k]] != dims[sumLocs[2*k+1]]) return false;
+		}
+		return true;
+	}(), "summed indexes must have matching dimensions");
+
+	using Scalar = decltype(typename TA::Scalar() * typename TB::Scalar());
+	auto sumAt = [&](auto const & dstI) -> Scalar {
+		Scalar sum = {};
+		std::array<int, numSums> k = {};
+		for (;;) {
+			intN<rankA> ai;
+			intN<rankB> bi;
+			for (int p = 0; p < numIndexes; ++p) {
+				int const src = srcForIndex[p];
+				int const v = src >= 0 ? dstI[src] : k[-1-src];
+				if (p < rankA) {
+					ai[p] = v;
+				} else {
+					bi[p - rankA] = v;
+				}
+			}
+			sum += a(ai) * b(bi);
+			// increment the summed indexes
+			int s = 0;
+			for (; s < numSums; ++s) {
+				if (++k[s] < sumDims[s]) break;
+				k[s] = 0;
+			}
+			if (s == numSums) break;
+		}
+		return sum;
+	};
+
+	if constexpr (Details::rank == 0) {
+		return sumAt(std::array<int, 0>{});
+	} else {
+		return R([&](intN<Details::rank> i) -> Scalar {
+			return sumAt(i);
+		});
+	}
+}
+
+template<typename... Factors>
+struct TensorMulExpr;
+
+template<typename T>
+struct is_TensorMulExpr : public std::false_type {};
+template<typename... Factors>
+struct is_TensorMulExpr<TensorMulExpr<Factors...>> : public std::true_type {};
+template<typename T>
+constexpr bool is_TensorMulExpr_v = is_TensorMulExpr<T>::value;
+
+// true if no index in IndexTuple is used more than twice
+// used to decide if two products can be merged into one chain
+template<typename IndexTuple>
+constexpr bool indexesAppearAtMostTwice = []<typename... Ps>(std::tuple<Ps...> *) constexpr {
+	return ((Ps::second_type::size() <= 2) && ... && true);
+}((GatherIndexes<IndexTuple>*)nullptr);
+
+// a tensor (or Scalar) that was produced mid-contraction, along with the indexes it is associated with
+template<typename TensorType_, typename IndexTuple_>
+struct ContractedFactor {
+	using TensorType = TensorType_;
+	using IndexTuple = IndexTuple_;
+	TensorType t;
+};
+
+/*
+contraction plan for a chain of index-notation products a(i,j) * b(j,k) * c(k,l) * ...
+Rather than contracting left-to-right, this picks the pairwise contraction order with the least operations at compile time,
+the same as einsum path optimization:
+	cost(S) = min over splits S = S1 u S2 of cost(S1) + cost(S2) + (product of the dims of all indexes kept by S1 or S2)
+where the indexes kept by a subset of factors are those that are either free in the whole product or used by a factor outside the subset.
+Factors are tracked as bitmasks.
+*/
+template<typename... Factors>
+struct TensorMulPlan {
+	static constexpr int numFactors = sizeof...(Factors);
+	static_assert(numFactors >= 2);
+	static_assert(numFactors < 16, "that is a lot of factors");
+	static constexpr unsigned allFactors = (1u << numFactors) - 1;
+	
+	using IndexTuple = Common::tuple_cat_t<typename Factors::AssignIndexTuple...>;
+	using Details = IndexAccessDetails<IndexTuple>;
+	using Scalar = decltype((typename Factors::Scalar() * ...));
+	
+	using GatheredIndexes = GatherIndexes<IndexTuple>;
+	static constexpr int numDistinct = std::tuple_size_v<GatheredIndexes>;
+	static_assert(numDistinct <= 64);
+
+	struct Data {
+		std::array<std::size_t, allFactors+1> cost = {};
+		std::array<unsigned, allFactors+1> split = {};	// S1 of the best split of S, S2 = S ^ S1
+		std::array<std::uint64_t, allFactors+1> keep = {};	// mask of distinct indexes kept by a subset
+	};
+
+	static constexpr Data data = []() constexpr {
+		constexpr auto dims = seqToArray<Common::seq_cat_t<int, typename Factors::dimseq...>>();
+		constexpr std::array<int, numFactors> ranks = {Factors::rank...};
+		
+		// distinct index of each location in IndexTuple, and how many times each distinct index is used
+		std::array<int, std::tuple_size_v<IndexTuple>> distinctForLoc = {};
+		std::array<int, numDistinct> distinctDim = {};
+		std::array<int, numDistinct> distinctCount = {};
+		[&]<int... d>(std::integer_sequence<int, d...>) constexpr {
+			([&]() constexpr {
+				constexpr auto locs = seqToArray<typename std::tuple_element_t<d, GatheredIndexes>::second_type>();
+				for (int loc : locs) distinctForLoc[loc] = d;
+				distinctDim[d] = dims[locs[0]];
+				distinctCount[d] = (int)locs.size();
+			}(), ...);
+		}(std::make_integer_sequence<int, numDistinct>{});
+		
+		// distinct indexes used by each factor
+		std::array<std::uint64_t, numFactors> factorIndexes = {};
+		for (int f = 0, loc = 0; f < numFactors; ++f) {
+			for (int k = 0; k < ranks[f]; ++k, ++loc) {
+				factorIndexes[f] |= std::uint64_t(1) << distinctForLoc[loc];
+			}
+		}
+		std::uint64_t freeIndexes = {};
+		for (int d = 0; d < numDistinct; ++d) {
+			if (distinctCount[d] == 1) freeIndexes |= std::uint64_t(1) << d;
+		}
+		
+		Data result;
+		for (unsigned S = 1; S <= allFactors; ++S) {
+			std::uint64_t inside = {}, outside = {};
+			for (int f = 0; f < numFactors; ++f) {
+				(S & (1u << f) ? inside : outside) |= factorIndexes[f];
+			}
+			result.keep[S] = inside & (outside | freeIndexes);
+			if (!(S & (S - 1))) continue;	// single factors cost nothing
+			result.cost[S] = (std::size_t)-1;
+			for (unsigned S1 = (S - 1) & S; S1; S1 = (S1 - 1) & S) {
+				unsigned const S2 = S ^ S1;
+				if (S1 > S2) continue;	// each split once
+				std::uint64_t const used = result.keep[S1] | result.keep[S2];
+				std::size_t ops = 1;
+				for (int d = 0; d < numDistinct; ++d) {
+					if (used & (std::uint64_t(1) << d)) ops *= distinctDim[d];
+				}
+				std::size_t const cost = result.cost[S1] + result.cost[S2] + ops;
+				if (cost < result.cost[S]) {
+					result.cost[S] = cost;
+					result.split[S] = S1;
+				}
+			}
+		}
+		return result;
+	}();
+
+	// total multiply-adds of the chosen order
+	static constexpr std::size_t contractionCost = data.cost[allFactors];
+
+	/*
+	the chosen order, as the bitmasks of the two subsets of factors contracted at each step, in the order they are evaluated.
+	ex: for a(i,j) * b(j,k) * v(k) this will be {{2,4}, {1,6}}, i.e. b*v first, then a*(b*v)
+	*/
+	static constexpr auto contractionOrder = []() constexpr {
+		std::array<std::pair<unsigned, unsigned>, numFactors-1> result = {};
+		int n = 0;
+		auto visit = [&](auto & self, unsigned S) constexpr -> void {
+			if (!(S & (S - 1))) return;
+			unsigned const S1 = data.split[S];
+			unsigned const S2 = S ^ S1;
+			self(self, S1);
+			self(self, S2);
+			result[n++] = {S1, S2};
+		};
+		visit(visit, allFactors);
+		return result;
+	}();
+
+	// human-readable form of contractionOrder, like "(0*(1*2))"
+	static std::string contractionOrderString(unsigned S = allFactors) {
+		if (!(S & (S - 1))) {
+			int f = 0;
+			while (!(S & (1u << f))) ++f;
+			return std::to_string(f);
+		}
+		unsigned const S1 = data.split[S];
+		return "(" + contractionOrderString(S1) + "*" + contractionOrderString(S ^ S1) + ")";
+	}
+
+	// held by value: factors are evaluated upon the first read, after the full-expression that built them (and its temporary nodes) has ended
+	// the leaf IndexAccess nodes are only a tensor reference and index tags to copy, and the other nodes hold their operands by value too
+	using FactorTuple = std::tuple<Factors...>;
+
+	template<unsigned S>
+	static auto evalSubset(FactorTuple const & factors) {
+		if constexpr (!(S & (S - 1))) {
+			constexpr int f = std::countr_zero(S);
+			using F = std::tuple_element_t<f, std::tuple<Factors...>>;
+			auto t = std::get<f>(factors).assignI();	// indexes are F::AssignIndexTuple
+			return ContractedFactor<decltype(t), typename F::AssignIndexTuple>{t};
+		} else {
+			constexpr unsigned S1 = data.split[S];
+			constexpr unsigned S2 = S ^ S1;
+			auto l = evalSubset<S1>(factors);
+			auto r = evalSubset<S2>(factors);
+			using L = decltype(l);
+			using R = decltype(r);
+			constexpr int lrank = std::tuple_size_v<typename L::IndexTuple>;
+			constexpr int rrank = std::tuple_size_v<typename R::IndexTuple>;
+			if constexpr (lrank == 0 || rrank == 0) {
+				// a fully-contracted subset is just a scalar multiply
+				using ResultIndexTuple = std::conditional_t<lrank == 0, typename R::IndexTuple, typename L::IndexTuple>;
+				auto t = l.t * r.t;
+				return ContractedFactor<decltype(t), ResultIndexTuple>{t};
+			} else {
+				using PairIndexTuple = Common::tuple_cat_t<typename L::IndexTuple, typename R::IndexTuple>;
+				using PairDetails = IndexAccessDetails<PairIndexTuple>;
+				using inputDims = Common::seq_cat_t<int, typename L::TensorType::dimseq, typename R::TensorType::dimseq>;
+				using dimseq = Common::SeqToSeqMap<typename PairDetails::AssignIndexSeq, GetSeqIth<inputDims>::template go>;
+				if constexpr (PairDetails::rank == 0) {
+					return ContractedFactor<Scalar, std::tuple<>>{
+						contractFused<PairIndexTuple, Scalar>(l.t, r.t)
+					};
+				} else {
+					// outer product with the summed indexes removed, to preserve symmetry of the remaining indexes
+					using ResultType = typename decltype(outer(l.t, r.t))::template RemoveIndexSeq<typename PairDetails::SumIndexSeq>;
+					static_assert(std::is_same_v<typename ResultType::dimseq, dimseq>);
+					return ContractedFactor<ResultType, typename PairDetails::AssignIndexTuple>{
+						contractFused<PairIndexTuple, ResultType>(l.t, r.t)
+					};
+				}
+			}
+		}
+	}
+
+	static auto eval(FactorTuple const & factors) {
+		return evalSubset<allFactors>(factors);
+	}
+};
+
+/*
+tensor * tensor * ...
+Products are collected into one node and only evaluated once they are read, using the contraction order of TensorMulPlan.
+The result is cached in the node.
+*/
+template<typename... Factors>
 struct TensorMulExpr {
+	static_assert((is_IndexExpr_v<Factors> && ...));
 	static constexpr bool isIndexExprFlag = {};
 	using This = TensorMulExpr;
+	using Plan = TensorMulPlan<Factors...>;
 
-	using IndexTuple = Common::tuple_cat_t<typename A::AssignIndexTuple, typename B::AssignIndexTuple>;
-	using Details = IndexAccessDetails<IndexTuple>;
+	using IndexTuple = typename Plan::IndexTuple;
+	using Details = typename Plan::Details;
 	using SumIndexSeq = typename Details::SumIndexSeq;
 	using AssignIndexSeq = typename Details::AssignIndexSeq;
 	using AssignIndexTuple = typename Details::AssignIndexTuple;
 	
-	using inputDims = Common::seq_cat_t<int, typename A::dimseq, typename B::dimseq>;
+	using inputDims = Common::seq_cat_t<int, typename Factors::dimseq...>;
 	using dimseq = Common::SeqToSeqMap<AssignIndexSeq, GetSeqIth<inputDims>::template go>;
 	
-	using Scalar = decltype(typename A::Scalar() * typename B::Scalar());
-	using OutputTensorType = tensorScalarSeq<Scalar, dimseq>;
+	using Scalar = typename Plan::Scalar;
+	// use the storage of the last contraction, if its indexes are already in order
+	using EvalResult = decltype(Plan::eval(std::declval<typename Plan::FactorTuple>()));
+	using OutputTensorType = std::conditional_t<
+		std::is_same_v<typename EvalResult::IndexTuple, AssignIndexTuple>,
+		typename EvalResult::TensorType,
+		tensorScalarSeq<Scalar, dimseq>
+	>;
 	static constexpr int rank = Details::rank;
 	using intN = vec<int, rank>;
+
+	static constexpr std::size_t contractionCost = Plan::contractionCost;
+	static constexpr auto contractionOrder = Plan::contractionOrder;
+	static std::string contractionOrderString() { return Plan::contractionOrderString(); }
 	
 	TENSOR_EXPR_ADD_ASSIGNR()
 
-	// .read() needs an IndexAccess ... but .read() is called multiple times ... so lets not rebuild the IndexAccess each time
-	// but IndexAccess (when not caching from traces) holds a ref to its tuple
-	//  (TODO flag for manual toggling IndexAccess when to cache vs lazy eval)
-	//  so I'm holding the tensor first, then passing it as a ref to the IndexAccess next
-	//  and last using the IndexAccess in .read()
-	OutputTensorType ct;
-	IndexAccess<OutputTensorType, AssignIndexTuple> c;
-	IndexAccess<OutputTensorType, AssignIndexTuple> initC(A const & a, B const & b) {
-		auto at = a.assignI(); // indexes are A::AssignIndexTuple
-		auto bt = b.assignI();
-		// InputTuple = concat'd A::AssignInputTuple & B::AssignIndexTuple
-		// SumIndexSeq are the duplicates of InputTuple 
-		// those will be the contracted indexes of 'c'
-		auto aob = outer(at, bt);
-		ct = applyTraces<SumIndexSeq>(aob);
-		return std::apply(ct, AssignIndexTuple());
-	}
-	TensorMulExpr(A const & a, B const & b) : c(initC(a,b)) {}
+	using FactorTuple = typename Plan::FactorTuple;
+	FactorTuple factors;
+	
+	// cache the result upon first read
+	mutable OutputTensorType ct;
+	mutable bool evaluated = false;
+	mutable TensorMulExpr const * shared = {};	// set by shareSubexprs for the length of one assignment
+
+	TensorMulExpr(FactorTuple const & factors_) : factors(factors_) {}
+
+	// the whole product is evaluated into 'ct' upon the first read, before anything is written
+	static constexpr bool mayAlias = false;
+	bool aliases(void const *, void const *) const { return false; }
+
+	bool sameExpr(This const & o) const {
+		return [&]<size_t ... f>(std::index_sequence<f...>) {
+			return (std::get<f>(factors).sameExpr(std::get<f>(o.factors)) && ...);
+		}(std::make_index_sequence<sizeof...(Factors)>{});
+	}
+	void shareSubexprs(SubexprRegistry & reg) const {
+		std::apply([&](auto const & ... f) {
+			(f.shareSubexprs(reg), ...);
+		}, factors);
+		auto const first = reg.find(*this);
+		if (first != this) reg.link(*this, first);
+	}
+
+	void eval() const {
+		auto result = Plan::eval(factors);
+		using ResultIndexTuple = typename decltype(result)::IndexTuple;
+		if constexpr (std::is_same_v<ResultIndexTuple, AssignIndexTuple>) {
+			ct = result.t;
+		} else {
+			// the last contraction can leave the free indexes in a different order
+			std::apply(ct, AssignIndexTuple()) = std::apply(result.t, ResultIndexTuple());
+		}
+		evaluated = true;
+	}
 
 	template<typename DstIndexTuple, typename DstDimSeq>
 	constexpr Scalar read(intN const & i) const {
-		return c.template read<DstIndexTuple, DstDimSeq>(i);
+		if (shared) return shared->template read<DstIndexTuple, DstDimSeq>(i);
+		if (!evaluated) eval();
+		return std::apply(ct, AssignIndexTuple()).template read<DstIndexTuple, DstDimSeq>(i);
 	}
 };
+
+// the factors of a product, or the expression itself if it is not a product
+template<typename T>
+auto getMulFactors(T const & t) {
+	if constexpr (is_TensorMulExpr_v<T>) {
+		return t.factors;
+	} else {
+		return std::tuple<T>(t);
+	}
+}
+
+template<typename FactorTuple>
+struct TensorMulExprForFactors;
+template<typename... Factors>
+struct TensorMulExprForFactors<std::tuple<Factors...>> {
+	using type = TensorMulExpr<Factors...>;
+	using Plan = TensorMulPlan<Factors...>;	// without instanciating the TensorMulExpr, which might be rank-0
+};
+
 template<typename A, typename B>
 requires (
 	is_IndexExpr_v<A>
 	&& is_IndexExpr_v<B>
 )
 decltype(auto) operator*(A const & a, B const & b) {
+	// merge with the factors of a and b if they are products themselves
+	// unless the merge would make an index appear more than twice, as in (a(i,j) * b(j)) * c(j)
+	using ABIndexTuple = Common::tuple_cat_t<typename A::AssignIndexTuple, typename B::AssignIndexTuple>;
+	auto factors = [&]() {
+		using AllFactors = decltype(std::tuple_cat(getMulFactors(a), getMulFactors(b)));
+		using AllIndexTuple = typename TensorMulExprForFactors<AllFactors>::Plan::IndexTuple;
+		if constexpr (indexesAppearAtMostTwice<AllIndexTuple>) {
+			return std::tuple_cat(getMulFactors(a), getMulFactors(b));
+		} else {
+			return std::tuple<A, B>(a, b);
+		}
+	}();
+	using ExprForFactors = TensorMulExprForFactors<decltype(factors)>;
 	// Just like tensor::operator()(IndexBase...) has to decide beforehand whether it should return a Scalar or not
 	// We have to do the test here too.
-	using IndexTuple = Common::tuple_cat_t<typename A::AssignIndexTuple, typename B::AssignIndexTuple>;
-	using Details = IndexAccessDetails<IndexTuple>;	
+	using Details = IndexAccessDetails<ABIndexTuple>;	
 	if constexpr (Details::rank == 0) {
-		auto at = a.assignI();
-		auto bt = b.assignI();
-		auto aob = outer(at, bt);
-		auto result = applyTraces<typename Details::SumIndexSeq>(aob);
-		using Scalar = decltype(typename A::Scalar() * typename B::Scalar());
-		static_assert(std::is_same_v<decltype(result), Scalar>);
+		using Plan = typename ExprForFactors::Plan;
+		auto result = Plan::eval(factors).t;
+		static_assert(std::is_same_v<decltype(result), typename Plan::Scalar>);
 		return result;
 	} else {
-		return TensorMulExpr<A, B>(a,b);
+		return typename ExprForFactors::type(factors);
 	}
 }
-#endif
 
 // tensor + scalar
 
@@ -733,11 +1442,23 @@ struct TensorScalarExpr {
 	using Scalar = typename T::Scalar; // TODO which Scalar to use?
 	TENSOR_EXPR_ADD_ASSIGNR()
 
-	T const & a;
-	Scalar const & b;
+	T a;
+	Scalar b;	// by value, so an in-place assign can't change it, i.e. c(i,j) = b(i,j) * c(0,0)
 	
 	TensorScalarExpr(T const & a_, Scalar const & b_) : a(a_), b(b_) {}
 
+	static constexpr bool mayAlias = T::mayAlias;
+	bool aliases(void const * begin, void const * end) const {
+		return a.aliases(begin, end);
+	}
+
+	bool sameExpr(This const & o) const {
+		return a.sameExpr(o.a) && b == o.b;
+	}
+	void shareSubexprs(SubexprRegistry & reg) const {
+		a.shareSubexprs(reg);
+	}
+
 	template<typename DstIndexTuple, typename DstDimSeq>
 	constexpr Scalar read(intN const & i) const {
 		return op<Scalar>()(a.template read<DstIndexTuple, DstDimSeq>(i), b);
@@ -758,11 +1479,23 @@ struct ScalarTensorExpr {
 	using Scalar = typename T::Scalar; // TODO which Scalar to use?
 	TENSOR_EXPR_ADD_ASSIGNR()
 	
-	Scalar const & a;
-	T const & b;
+	Scalar a;	// by value, same as TensorScalarExpr
+	T b;
 	
 	ScalarTensorExpr(Scalar const & a_, T const & b_) : a(a_), b(b_) {}
 
+	static constexpr bool mayAlias = T::mayAlias;
+	bool aliases(void const * begin, void const * end) const {
+		return b.aliases(begin, end);
+	}
+
+	bool sameExpr(This const & o) const {
+		return a == o.a && b.sameExpr(o.b);
+	}
+	void shareSubexprs(SubexprRegistry & reg) const {
+		b.shareSubexprs(reg);
+	}
+
 	template<typename DstIndexTuple, typename DstDimSeq>
 	constexpr Scalar read(intN const & i) const {
 		return op<Scalar>()(a, b.template read<DstIndexTuple, DstDimSeq>(i));
@@ -811,10 +1544,22 @@ struct UnaryTensorExpr {
 	using Scalar = typename T::Scalar;
 	TENSOR_EXPR_ADD_ASSIGNR()
 	
-	T const & t;
+	T t;
 
 	UnaryTensorExpr(T const & t_) : t(t_) {}
 
+	static constexpr bool mayAlias = T::mayAlias;
+	bool aliases(void const * begin, void const * end) const {
+		return t.aliases(begin, end);
+	}
+
+	bool sameExpr(This const & o) const {
+		return t.sameExpr(o.t);
+	}
+	void shareSubexprs(SubexprRegistry & reg) const {
+		t.shareSubexprs(reg);
+	}
+
 	template<typename DstIndexTuple, typename DstDimSeq>
 	constexpr Scalar read(intN const & i) const {
 		return op<Scalar>()(t.template read<DstIndexTuple, DstDimSeq>(i));
@@ -7,11 +7,16 @@ namespace Tensor {
 //index-access classes
 struct IndexBase;
 
-template<char ident>
+template<char ident, int offset = 0, int size = 0>
 struct Index;
 
+//trace evaluation policies for IndexAccess
+struct IndexEvalAuto;
+struct IndexEvalCache;
+struct IndexEvalLazy;
+
 //forward-declare for tensors's operator() used for index-notation
-template<typename InputTensorType, typename IndexVector>
+template<typename InputTensorType, typename IndexVector, typename EvalPolicy = IndexEvalAuto>
 requires is_tensor_v<InputTensorType>
 struct IndexAccess;
 
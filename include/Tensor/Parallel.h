@@ -0,0 +1,352 @@
+#pragma once
+
+#include "Tensor/Grid.h"
+#include "Common/Exception.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <type_traits>
+#include <algorithm>	//max, min
+
+/*
+multithreaded loops over Grids and GridViews, on a reusable pool of std::threads.
+
+parallelFor(size, f) calls f(intN) for every index in [0,size).
+parallelForRows(size, f) calls f(intN) for the first index of every row along dimension 0, for kernels that sweep whole rows.
+parallelFill(dst, f) sets dst(i) = f(i).
+parallelTransform(dst, src, f) sets dst(i) = f(src(i)) into an existing grid.
+parallelMap(src, f) does the same into a new Grid, like Grid::map.
+parallelReduce / parallelTransformReduce / parallelSum / parallelMin / parallelMax reduce a grid to one value.
+
+Reductions combine fixed-size blocks in block order, so for a given block size the result is the same for any number of threads.
+The functions passed in must be safe to call concurrently.
+*/
+
+namespace Tensor {
+
+/*
+fixed set of worker threads, reused across calls.
+run(numTasks, task) calls task(0) ... task(numTasks-1), spread across the workers and the calling thread, and returns once they are all done.
+run() called from within a task runs serially on its thread, so nested parallel loops don't deadlock.
+If a task throws then the remaining tasks are skipped and the first exception is rethrown from run().
+*/
+struct ThreadPool {
+	explicit ThreadPool(int numThreads_ = (int)std::max(1u, std::thread::hardware_concurrency())) {
+		for (int i = 1; i < numThreads_; ++i) {
+			workers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool & operator=(ThreadPool const &) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeCV.notify_all();
+		for (auto & worker : workers) worker.join();
+	}
+
+	// including the calling thread
+	int numThreads() const { return (int)workers.size() + 1; }
+
+	void run(int numTasks, std::function<void(int)> const & task) {
+		if (numTasks <= 0) return;
+		if (numTasks == 1 || workers.empty() || insideTask) {
+			for (int i = 0; i < numTasks; ++i) task(i);
+			return;
+		}
+
+		std::lock_guard<std::mutex> runLock(runMutex);	// one job at a time per pool
+		Job job(task, numTasks);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			current = &job;
+			++generation;
+		}
+		wakeCV.notify_all();
+		work(job);
+		{
+			// every task is claimed by now, wait for the workers still running theirs
+			std::unique_lock<std::mutex> lock(mutex);
+			doneCV.wait(lock, [&]() { return job.active == 0; });
+			current = nullptr;
+		}
+		if (job.error) std::rethrow_exception(job.error);
+	}
+
+	static ThreadPool & global() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+protected:
+	struct Job {
+		std::function<void(int)> const & task;
+		int numTasks;
+		std::atomic<int> next = {};
+		std::atomic<bool> failed = {};
+		int active = {};	// workers in work(), guarded by mutex
+		std::mutex errorMutex;
+		std::exception_ptr error;
+
+		Job(std::function<void(int)> const & task_, int numTasks_)
+		: task(task_), numTasks(numTasks_) {}
+	};
+
+	static void work(Job & job) {
+		bool const wasInsideTask = insideTask;
+		insideTask = true;
+		for (;;) {
+			int const i = job.next.fetch_add(1);
+			if (i >= job.numTasks) break;
+			if (job.failed) continue;
+			try {
+				job.task(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(job.errorMutex);
+				if (!job.error) job.error = std::current_exception();
+				job.failed = true;
+			}
+		}
+		insideTask = wasInsideTask;
+	}
+
+	void workerLoop() {
+		std::size_t seenGeneration = {};
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wakeCV.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+			if (stopping) return;
+			seenGeneration = generation;
+			Job * job = current;
+			if (!job) continue;
+			++job->active;
+			lock.unlock();
+			work(*job);
+			lock.lock();
+			if (--job->active == 0) doneCV.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex runMutex;
+	std::mutex mutex;
+	std::condition_variable wakeCV, doneCV;
+	Job * current = {};
+	std::size_t generation = {};
+	bool stopping = {};
+
+	static inline thread_local bool insideTask = false;
+};
+
+/*
+how a parallel loop splits its cells into blocks of consecutive flat indexes (in memory order) among the threads.
+Static gives each thread one contiguous block, for uniform per-cell cost.
+Dynamic hands out blocks of chunkSize as threads free up, for uneven per-cell cost.
+Reductions always use blocks of chunkSize, handed out dynamically.
+*/
+struct ParallelPolicy {
+	enum Schedule { Static, Dynamic };
+	Schedule schedule = Static;
+	int chunkSize = 0;	// 0 picks one
+	ThreadPool * pool = nullptr;	// null uses ThreadPool::global()
+
+	ThreadPool & getPool() const { return pool ? *pool : ThreadPool::global(); }
+};
+
+// block size of reductions when ParallelPolicy::chunkSize is 0
+constexpr int parallelReduceChunkSize = 4096;
+
+// calls f(begin, end) over disjoint blocks covering [0,n)
+template<typename F>
+void parallelForBlocks(int n, F && f, ParallelPolicy const & policy = {}) {
+	if (n <= 0) return;
+	ThreadPool & pool = policy.getPool();
+	int const numThreads = pool.numThreads();
+	if (policy.schedule == ParallelPolicy::Static) {
+		int const numTasks = std::min(numThreads, n);
+		pool.run(numTasks, [&](int t) {
+			f((int)((long long)n * t / numTasks), (int)((long long)n * (t + 1) / numTasks));
+		});
+	} else {
+		// default to 8 blocks per thread
+		int const chunkSize = policy.chunkSize > 0 ? policy.chunkSize : std::max(1, n / (8 * numThreads));
+		int const numTasks = (n + chunkSize - 1) / chunkSize;
+		pool.run(numTasks, [&](int t) {
+			f(t * chunkSize, std::min(n, (t + 1) * chunkSize));
+		});
+	}
+}
+
+// index of the offset'th element in memory order, first index fastest
+template<int rank>
+intN<rank> gridIndexForOffset(intN<rank> const & size, int offset) {
+	intN<rank> i;
+	for (int j = 0; j < rank; ++j) {
+		i(j) = offset % size(j);
+		offset /= size(j);
+	}
+	return i;
+}
+
+// calls f(i) for each index i in [0,size)
+template<int rank, typename F>
+void parallelFor(intN<rank> const & size, F && f, ParallelPolicy const & policy = {}) {
+	parallelForBlocks(size.product(), [&](int begin, int end) {
+		auto i = gridIndexForOffset(size, begin);
+		for (int k = begin; k < end; ++k) {
+			f((intN<rank> const &)i);
+			for (int j = 0; j < rank; ++j) {
+				if (++i(j) < size(j)) break;
+				i(j) = 0;
+			}
+		}
+	}, policy);
+}
+
+// calls f(i) for each i in [0,size) with i(0) == 0, when size(0) > 0
+template<int rank, typename F>
+void parallelForRows(intN<rank> const & size, F && f, ParallelPolicy const & policy = {}) {
+	if (!size.product()) return;
+	auto rows = size;
+	rows(0) = 1;
+	parallelFor(rows, f, policy);
+}
+
+// Grid to its view, GridView to itself
+template<typename G>
+auto parallelViewOf(G && g) {
+	if constexpr (requires { g.view(); }) {
+		return g.view();
+	} else {
+		return g;
+	}
+}
+
+// dst(i) = f(i) for a Grid or GridView dst
+template<typename G, typename F>
+void parallelFill(G && dst, F && f, ParallelPolicy const & policy = {}) {
+	auto const d = parallelViewOf(dst);
+	parallelFor(d.size, [&](auto const & i) {
+		d(i) = f(i);
+	}, policy);
+}
+
+// dst(i) = f(src(i)) for Grids or GridViews of the same size
+template<typename D, typename S, typename F>
+void parallelTransform(D && dst, S const & src, F && f, ParallelPolicy const & policy = {}) {
+	auto const d = parallelViewOf(dst);
+	auto const s = parallelViewOf(src);
+	if (d.size != s.size) throw Common::Exception() << "tried to transform size " << s.size << " into size " << d.size;
+	if (d.isContiguous() && s.isContiguous()) {
+		parallelForBlocks(d.size.product(), [&](int begin, int end) {
+			auto * const dv = d.v;
+			auto const * const sv = s.v;
+			for (int k = begin; k < end; ++k) {
+				dv[k] = f(sv[k]);
+			}
+		}, policy);
+	} else {
+		parallelFor(d.size, [&](auto const & i) {
+			d(i) = f(s(i));
+		}, policy);
+	}
+}
+
+// parallel Grid::map, into a new Grid with the same allocator as src if src is a Grid
+template<typename S, typename F>
+auto parallelMap(S const & src, F && f, ParallelPolicy const & policy = {}) {
+	auto const s = parallelViewOf(src);
+	using Return = std::decay_t<std::invoke_result_t<F &, typename decltype(s)::Type &>>;
+	constexpr int rank = decltype(s)::rank;
+	if constexpr (requires { src.alloc; }) {
+		using ReturnAllocator = typename std::allocator_traits<std::decay_t<decltype(src.alloc)>>::template rebind_alloc<Return>;
+		auto result = Grid<Return, rank, ReturnAllocator>(s.size, GridNoInit(), ReturnAllocator(src.alloc));
+		parallelTransform(result, s, f, policy);
+		return result;
+	} else {
+		auto result = Grid<Return, rank>(s.size, GridNoInit());
+		parallelTransform(result, s, f, policy);
+		return result;
+	}
+}
+
+/*
+reduce(... reduce(reduce(init, transform(src(0))), transform(src(1))) ...) , but parallel.
+Blocks of policy.chunkSize cells (in memory order) are reduced first, then the block results are reduced in order onto init.
+reduce should be associative.
+*/
+template<typename S, typename Result, typename Reduce, typename Transform>
+Result parallelTransformReduce(S const & src, Result init, Reduce && reduce, Transform && transform, ParallelPolicy const & policy = {}) {
+	auto const s = parallelViewOf(src);
+	int const n = s.size.product();
+	if (n <= 0) return init;
+	int const chunkSize = policy.chunkSize > 0 ? policy.chunkSize : parallelReduceChunkSize;
+	int const numBlocks = (n + chunkSize - 1) / chunkSize;
+	std::vector<Result> blockResults(numBlocks);
+	bool const contiguous = s.isContiguous();
+	policy.getPool().run(numBlocks, [&](int b) {
+		int const begin = b * chunkSize;
+		int const end = std::min(n, begin + chunkSize);
+		if (contiguous) {
+			Result r = transform(s.v[begin]);
+			for (int k = begin + 1; k < end; ++k) {
+				r = reduce(std::move(r), transform(s.v[k]));
+			}
+			blockResults[b] = std::move(r);
+		} else {
+			auto i = gridIndexForOffset(s.size, begin);
+			Result r = transform(s(i));
+			for (int k = begin + 1; k < end; ++k) {
+				for (int j = 0; j < s.rank; ++j) {
+					if (++i(j) < s.size(j)) break;
+					i(j) = 0;
+				}
+				r = reduce(std::move(r), transform(s(i)));
+			}
+			blockResults[b] = std::move(r);
+		}
+	});
+	for (auto & r : blockResults) {
+		init = reduce(std::move(init), std::move(r));
+	}
+	return init;
+}
+
+template<typename S, typename Result, typename Reduce>
+Result parallelReduce(S const & src, Result init, Reduce && reduce, ParallelPolicy const & policy = {}) {
+	return parallelTransformReduce(src, std::move(init), reduce, [](auto const & x) -> Result { return x; }, policy);
+}
+
+template<typename S>
+auto parallelSum(S const & src, ParallelPolicy const & policy = {}) {
+	using Type = std::remove_const_t<typename decltype(parallelViewOf(src))::Type>;
+	return parallelReduce(src, Type(), [](Type const & a, Type const & b) -> Type { return a + b; }, policy);
+}
+
+// throws on empty grids
+template<typename S>
+auto parallelMin(S const & src, ParallelPolicy const & policy = {}) {
+	auto const s = parallelViewOf(src);
+	using Type = std::remove_const_t<typename decltype(s)::Type>;
+	if (!s.size.product()) throw Common::Exception() << "parallelMin of an empty grid";
+	return parallelReduce(s, s(typename decltype(s)::intN()), [](Type const & a, Type const & b) -> Type { return b < a ? b : a; }, policy);
+}
+
+// throws on empty grids
+template<typename S>
+auto parallelMax(S const & src, ParallelPolicy const & policy = {}) {
+	auto const s = parallelViewOf(src);
+	using Type = std::remove_const_t<typename decltype(s)::Type>;
+	if (!s.size.product()) throw Common::Exception() << "parallelMax of an empty grid";
+	return parallelReduce(s, s(typename decltype(s)::intN()), [](Type const & a, Type const & b) -> Type { return a < b ? b : a; }, policy);
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Tensor/Vector.h"
+#include <utility>	//pair
+#include <cmath>	//sqrt
+
+/*
+QR decomposition by Householder reflections, for static-sized matrices.
+
+qr(a) returns {Q, R} such that a = Q * R, Q is m x m orthogonal and R is m x n upper-triangular.
+qrInPlace(a) reduces a to R in place and returns Q, without the copy.
+
+R is a dense mat with its lower-left explicitly zeroed, on purpose:
+the storage types here (sym, asym, ident, ...) are all square with one symmetry between index orders, which a rectangular triangle doesn't have,
+and every consumer of R (back-substitution, R(i,i) signs, Q * R) wants plain mat indexing and operators.
+*/
+
+namespace Tensor {
+
+template<typename T, int m, int n>
+mat<T,m,m> qrInPlace(mat<T,m,n> & R) {
+	// R is reduced in-place, Q accumulates the product of reflections
+	mat<T,m,m> Q = ident<T,m>(1);
+	vec<T,m> v;	// only [k,m) is used for the k'th reflection
+	constexpr int numReflections = m - 1 < n ? m - 1 : n;
+	for (int k = 0; k < numReflections; ++k) {
+		T colNormSq = {};
+		for (int i = k; i < m; ++i) {
+			colNormSq += R(i,k) * R(i,k);
+		}
+		// pick the sign of alpha opposite R(k,k) to avoid cancellation in v(k)
+		T const colNorm = std::sqrt(colNormSq);
+		T const alpha = R(k,k) < T{} ? colNorm : -colNorm;
+		for (int i = k; i < m; ++i) {
+			v(i) = R(i,k);
+		}
+		v(k) -= alpha;
+		T vNormSq = {};
+		for (int i = k; i < m; ++i) {
+			vNormSq += v(i) * v(i);
+		}
+		if (vNormSq == T{}) continue;	// column is already reduced
+		T const scale = (T)2 / vNormSq;
+
+		// R = H R, only columns [k+1,n) change, column k is known
+		for (int j = k + 1; j < n; ++j) {
+			T s = {};
+			for (int i = k; i < m; ++i) {
+				s += v(i) * R(i,j);
+			}
+			s *= scale;
+			for (int i = k; i < m; ++i) {
+				R(i,j) -= s * v(i);
+			}
+		}
+		R(k,k) = alpha;
+		for (int i = k + 1; i < m; ++i) {
+			R(i,k) = {};
+		}
+
+		// Q = Q H
+		for (int r = 0; r < m; ++r) {
+			T s = {};
+			for (int i = k; i < m; ++i) {
+				s += Q(r,i) * v(i);
+			}
+			s *= scale;
+			for (int i = k; i < m; ++i) {
+				Q(r,i) -= s * v(i);
+			}
+		}
+	}
+	return Q;
+}
+
+template<typename T, int m, int n>
+std::pair<mat<T,m,m>, mat<T,m,n>> qr(mat<T,m,n> const & a) {
+	auto R = a;
+	auto const Q = qrInPlace(R);
+	return {Q, R};
+}
+
+/*
+solve a * x = b for x, for square 'a', by way of qr(a) and back-substitution.
+b can be a vector or a matrix of column vectors.
+*/
+template<typename T, int n, typename B>
+requires (
+	is_tensor_v<B>
+	&& B::template dim<0> == n
+	&& (B::rank == 1 || B::rank == 2)
+)
+B qrSolve(mat<T,n,n> const & a, B const & b) {
+	auto const [Q, R] = qr(a);
+	// x = R^-1 Q^T b
+	B x = Q.transpose() * b;
+	for (int i = n-1; i >= 0; --i) {
+		for (int j = i+1; j < n; ++j) {
+			x[i] -= R(i,j) * x[j];
+		}
+		x[i] /= R(i,i);
+	}
+	return x;
+}
+
+/*
+orthonormalize the rows of 'a', in order, like Gram-Schmidt would but by way of qr(transpose(a)).
+Each result row has a non-negative dot with its original row.
+Rows that are linearly dependent on prior rows are filled with some orthonormal completion.
+*/
+template<typename T, int m, int n>
+requires (m <= n)
+mat<T,m,n> orthonormalize(mat<T,m,n> const & a) {
+	auto const [Q, R] = qr(transpose(a));
+	return mat<T,m,n>([&](int i, int j) -> T {
+		return R(i,i) < T{} ? -Q(j,i) : Q(j,i);
+	});
+}
+
+}
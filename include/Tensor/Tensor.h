@@ -7,4 +7,7 @@
 #include "Tensor/Vector.h"	
 #include "Tensor/Quat.h"	
 #include "Tensor/Matrix.h"
+#include "Tensor/QR.h"
+#include "Tensor/Exp.h"
+#include "Tensor/Einsum.h"
 #include "Tensor/Valence.h"
@@ -1376,27 +1376,38 @@ so here i've gotta vet the IndexAccess creation ...
 which means duplicating some of the functionality of IndexAccess sorting out sum vs assign indexes
 */
 #define TENSOR_ADD_INDEX_NOTATION_CALL()\
-	template<typename ThisConst, typename IndexType, typename... IndexTypes>\
+	template<typename EvalPolicy, typename ThisConst, typename IndexType, typename... IndexTypes>\
 	static decltype(auto) callIndexOp(ThisConst & this_, IndexType, IndexTypes...) {\
 		/* get details first because we can't make IndexAccess until we know its |AssignIndexSeq| > 0 */\
 		using IndexTuple = std::tuple<IndexType, IndexTypes...>;\
 		using Details = IndexAccessDetails<IndexTuple>;\
 		if constexpr (Details::rank == 0) {\
-			return applyTraces<typename Details::SumIndexSeq>(this_);\
+			return applyIndexTraces<IndexTuple>(this_);\
 		} else {\
 			/* dont' instanciating this until you know IndexTuple has non-summed-indexes or else its rank = 0 and that's bad for its vector member types */\
-			return IndexAccess<ThisConst, IndexTuple>(this_);\
+			return IndexAccess<ThisConst, IndexTuple, EvalPolicy>(this_);\
 		}\
 	}\
 	template<typename IndexType, typename... IndexTypes>\
 	requires (Common::is_all_base_of_v<IndexBase, IndexType, IndexTypes...>)\
 	decltype(auto) operator()(IndexType i1, IndexTypes... is) {\
-		return callIndexOp<This>(*this, i1, is...);\
+		return callIndexOp<IndexEvalAuto, This>(*this, i1, is...);\
 	}\
 	template<typename IndexType, typename... IndexTypes>\
 	requires (Common::is_all_base_of_v<IndexBase, IndexType, IndexTypes...>)\
 	decltype(auto) operator()(IndexType i1, IndexTypes... is) const {\
-		return callIndexOp<This const>(*this, i1, is...);\
+		return callIndexOp<IndexEvalAuto, This const>(*this, i1, is...);\
+	}\
+	/* same as operator()(Index...) but with a trace evaluation policy: IndexEvalAuto, IndexEvalCache, IndexEvalLazy */\
+	template<typename EvalPolicy, typename IndexType, typename... IndexTypes>\
+	requires (Common::is_all_base_of_v<IndexBase, IndexType, IndexTypes...>)\
+	decltype(auto) indexEval(IndexType i1, IndexTypes... is) {\
+		return callIndexOp<EvalPolicy, This>(*this, i1, is...);\
+	}\
+	template<typename EvalPolicy, typename IndexType, typename... IndexTypes>\
+	requires (Common::is_all_base_of_v<IndexBase, IndexType, IndexTypes...>)\
+	decltype(auto) indexEval(IndexType i1, IndexTypes... is) const {\
+		return callIndexOp<EvalPolicy, This const>(*this, i1, is...);\
 	}
 
 //these are all per-element assignment operators,
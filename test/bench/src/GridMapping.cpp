@@ -0,0 +1,257 @@
+/*
+Benchmark of the MappedGrid index mappings on 7-point and 27-point stencils over a 3D grid of doubles.
+
+usage: bench [size...]
+	default sizes are 256 and 400.
+
+For each size and mapping it sweeps the interior once to warm up, then takes the best of 3 sweeps.
+Each sweep walks the grid brick by brick with forEachStencilRow, in memory order, and reads the neighborhood through the constant deltas of each run.
+"grid" is a hand-written loop over a linear Grid, for the cost of the brick path.
+
+On Linux the cache misses (PERF_COUNT_HW_CACHE_MISSES, usually last-level) and L1D read misses of the best sweep are read with perf_event_open.
+Where the counters aren't available (no PMU in a VM, or perf_event_paranoid too high) they print as n/a.
+The runs so far had no counters, and in them tiled and Morton were slower than linear, so no speedup or cache-miss reduction has been measured yet.
+*/
+#include "Tensor/Grid.h"
+#include "Tensor/GridMapping.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// one hardware counter, or nothing if it can't be opened
+struct PerfCounter {
+	int fd = -1;
+
+	PerfCounter(std::uint32_t type, std::uint64_t config) {
+#if defined(__linux__)
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~PerfCounter() {
+#if defined(__linux__)
+		if (fd >= 0) close(fd);
+#endif
+	}
+
+	PerfCounter(PerfCounter const &) = delete;
+	PerfCounter & operator=(PerfCounter const &) = delete;
+
+	void start() {
+#if defined(__linux__)
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// -1 if unavailable
+	long long stop() {
+#if defined(__linux__)
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			long long count = 0;
+			if (read(fd, &count, sizeof(count)) == sizeof(count)) return count;
+		}
+#endif
+		return -1;
+	}
+};
+
+struct Counters {
+#if defined(__linux__)
+	PerfCounter cacheMisses{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+	PerfCounter l1dMisses{PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+#else
+	PerfCounter cacheMisses{0, 0};
+	PerfCounter l1dMisses{0, 0};
+#endif
+};
+
+struct Result {
+	double ms = {};
+	long long cacheMisses = -1;
+	long long l1dMisses = -1;
+};
+
+// best of 3 after one warm-up sweep
+template<typename F>
+Result measure(Counters & counters, F && sweep) {
+	sweep();
+	Result best;
+	for (int rep = 0; rep < 3; ++rep) {
+		counters.cacheMisses.start();
+		counters.l1dMisses.start();
+		auto const t0 = std::chrono::steady_clock::now();
+		sweep();
+		auto const t1 = std::chrono::steady_clock::now();
+		auto const l1d = counters.l1dMisses.stop();
+		auto const llc = counters.cacheMisses.stop();
+		double const ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		if (rep == 0 || ms < best.ms) {
+			best.ms = ms;
+			best.cacheMisses = llc;
+			best.l1dMisses = l1d;
+		}
+	}
+	return best;
+}
+
+std::string countStr(long long n, long long cells) {
+	if (n < 0) return "n/a";
+	return std::to_string(n / 1000) + "k (" + std::to_string((double)n / (double)cells).substr(0, 5) + "/cell)";
+}
+
+void report(std::string const & name, std::string const & stencil, Result const & r, long long cells) {
+	std::cout
+		<< std::left << std::setw(12) << name
+		<< std::setw(8) << stencil
+		<< std::right << std::setw(10) << std::fixed << std::setprecision(1) << r.ms << " ms"
+		<< "   cache-misses " << std::setw(22) << countStr(r.cacheMisses, cells)
+		<< "   L1D-read-misses " << countStr(r.l1dMisses, cells)
+		<< std::endl;
+}
+
+template<typename Mapping>
+void benchMapping(std::string const & name, Tensor::int3 const & size, Counters & counters, double & checksum) {
+	using namespace Tensor;
+	auto src = MappedGrid<double, 3, Mapping>(size);
+	src.forEach([](int3 const & i, double & x) {
+		x = (double)(i(0) * i(1) % 7 + i(2) * i(2));
+	});
+	auto dst = MappedGrid<double, 3, Mapping>(size);
+	long long const cells = (long long)(size(0) - 2) * (size(1) - 2) * (size(2) - 2);
+
+	report(name, "7-pt", measure(counters, [&]() {
+		src.template forEachStencilRow<1>([&](int offset, int count, auto const & delta) {
+			double const * const s = src.v + offset;
+			double * const d = dst.v + offset;
+			int const xm = delta(0)(0), xp = delta(0)(2);
+			int const ym = delta(1)(0), yp = delta(1)(2);
+			int const zm = delta(2)(0), zp = delta(2)(2);
+			for (int i = 0; i < count; ++i) {
+				d[i] = -6. * s[i]
+					+ s[i + xm] + s[i + xp]
+					+ s[i + ym] + s[i + yp]
+					+ s[i + zm] + s[i + zp];
+			}
+		});
+	}), cells);
+	checksum += dst(size / 2);
+
+	report(name, "27-pt", measure(counters, [&]() {
+		src.template forEachStencilRow<1>([&](int offset, int count, auto const & delta) {
+			double const * const s = src.v + offset;
+			double * const d = dst.v + offset;
+			int o[9];
+			for (int c = 0; c < 3; ++c) {
+				for (int b = 0; b < 3; ++b) {
+					o[b + 3 * c] = delta(1)(b) + delta(2)(c);
+				}
+			}
+			int const xm = delta(0)(0), xp = delta(0)(2);
+			for (int i = 0; i < count; ++i) {
+				double sum = 0;
+				for (int bc = 0; bc < 9; ++bc) {
+					double const * const r = s + i + o[bc];
+					sum += r[xm] + r[0] + r[xp];
+				}
+				d[i] = sum - 27. * s[i];
+			}
+		});
+	}), cells);
+	checksum += dst(size / 2);
+}
+
+void benchGrid(Tensor::int3 const & size, Counters & counters, double & checksum) {
+	using namespace Tensor;
+	auto src = Grid<double, 3>(size, [](int3 i) -> double {
+		return (double)(i(0) * i(1) % 7 + i(2) * i(2));
+	});
+	auto dst = Grid<double, 3>(size);
+	long long const cells = (long long)(size(0) - 2) * (size(1) - 2) * (size(2) - 2);
+	int3 const step = src.step;
+
+	report("grid", "7-pt", measure(counters, [&]() {
+		for (int k = 1; k < size(2) - 1; ++k) {
+			for (int j = 1; j < size(1) - 1; ++j) {
+				double const * s = src.v + j * step(1) + k * step(2);
+				double * d = dst.v + j * step(1) + k * step(2);
+				for (int i = 1; i < size(0) - 1; ++i) {
+					d[i] = -6. * s[i]
+						+ s[i - 1] + s[i + 1]
+						+ s[i - step(1)] + s[i + step(1)]
+						+ s[i - step(2)] + s[i + step(2)];
+				}
+			}
+		}
+	}), cells);
+	checksum += dst(size / 2);
+
+	report("grid", "27-pt", measure(counters, [&]() {
+		for (int k = 1; k < size(2) - 1; ++k) {
+			for (int j = 1; j < size(1) - 1; ++j) {
+				double const * s = src.v + j * step(1) + k * step(2);
+				double * d = dst.v + j * step(1) + k * step(2);
+				for (int i = 1; i < size(0) - 1; ++i) {
+					double sum = 0;
+					for (int c = -1; c <= 1; ++c) {
+						for (int b = -1; b <= 1; ++b) {
+							double const * r = s + i + b * step(1) + c * step(2);
+							sum += r[-1] + r[0] + r[1];
+						}
+					}
+					d[i] = sum - 27. * s[i];
+				}
+			}
+		}
+	}), cells);
+	checksum += dst(size / 2);
+}
+
+int main(int argc, char ** argv) {
+	using namespace Tensor;
+	std::vector<int> sizes;
+	for (int i = 1; i < argc; ++i) sizes.push_back(std::atoi(argv[i]));
+	if (sizes.empty()) sizes = {256, 400};
+
+	Counters counters;
+	if (counters.cacheMisses.fd < 0) std::cout << "hardware cache counters unavailable, timings only" << std::endl;
+
+	double checksum = 0;
+	for (int n : sizes) {
+		auto const size = int3(n, n, n);
+		std::cout << "size " << size << std::endl;
+		benchGrid(size, counters, checksum);
+		benchMapping<GridMappingLinear>("linear", size, counters, checksum);
+		benchMapping<GridMappingTiled<8>>("tiled<8>", size, counters, checksum);
+		benchMapping<GridMappingTiled<16>>("tiled<16>", size, counters, checksum);
+		benchMapping<GridMappingMorton>("morton", size, counters, checksum);
+	}
+	// so the sweeps aren't optimized away
+	std::cout << "checksum " << checksum << std::endl;
+}
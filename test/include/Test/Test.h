@@ -16,7 +16,9 @@ void test_TotallySymmetric();
 void test_TotallyAntisymmetric();
 void test_Math();
 void test_Index();
+void test_Einsum();
 void test_Derivative();
+void test_Grid();
 void test_Valence();
 
 template<typename T>
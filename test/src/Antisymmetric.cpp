@@ -238,4 +238,47 @@ void test_Antisymmetric() {
 		auto az = a[2];
 		ECHO(az.lenSq());
 	}
+
+	// exp of antisymmetric generators
+	{
+		auto w = Tensor::double3a3(.3, -1.2, 2);
+		auto R = Tensor::exp(w);
+		// Rodrigues matches the general case
+		TEST_EQ_EPS(Tensor::normSq(R - Tensor::exp(Tensor::double3x3(w))), 0, 1e-20);
+		TEST_EQ_EPS(Tensor::normSq(R * R.transpose() - Tensor::double3x3(Tensor::ident<double,3>(1))), 0, 1e-20);
+		TEST_EQ_EPS(Tensor::normSq(Tensor::expQuat(w).toMatrix() - R), 0, 1e-20);
+		// small angles use the series
+		auto ws = Tensor::double3a3(1e-5, 0, 0);
+		TEST_EQ_EPS(Tensor::normSq(Tensor::exp(ws) - Tensor::exp(Tensor::double3x3(ws))), 0, 1e-20);
+	}
+	{
+		auto w = Tensor::asym<double,4>();
+		w(0,1) = .3; w(0,2) = -1.2; w(0,3) = .1; w(1,3) = 2; w(2,3) = .7;
+		TEST_EQ_EPS(Tensor::normSq(Tensor::exp(w) - Tensor::exp(Tensor::double4x4(w))), 0, 1e-20);
+		// isoclinic, i.e. both rotation angles match
+		auto wi = Tensor::asym<double,4>();
+		wi(0,1) = .3; wi(2,3) = .3;
+		TEST_EQ_EPS(Tensor::normSq(Tensor::exp(wi) - Tensor::exp(Tensor::double4x4(wi))), 0, 1e-20);
+		// nearly isoclinic, eigenvalues 1e-6 apart, against the two plane rotations
+		for (double dtheta : {1e-6, 3e-6, 1e-5}) {
+			double const t1 = 1.3, t2 = 1.3 + dtheta;
+			auto wn = Tensor::asym<double,4>();
+			wn(0,1) = t1; wn(2,3) = t2;
+			auto Rn = Tensor::double4x4();
+			Rn(0,0) = Rn(1,1) = cos(t1); Rn(0,1) = sin(t1); Rn(1,0) = -sin(t1);
+			Rn(2,2) = Rn(3,3) = cos(t2); Rn(2,3) = sin(t2); Rn(3,2) = -sin(t2);
+			TEST_EQ_EPS(Tensor::normSq(Tensor::exp(wn) - Rn), 0, 1e-26);
+		}
+		// Lorentz transforms preserve the metric
+		auto L = Tensor::expLorentz(w);
+		auto eta = Tensor::double4x4([](int i, int j) -> double { return i != j ? 0 : (i == 0 ? -1 : 1); });
+		TEST_EQ_EPS(Tensor::normSq(L.transpose() * eta * L - eta), 0, 1e-20);
+		// pure boost
+		auto b = Tensor::asym<double,4>();
+		b(0,1) = 1.5;
+		auto B = Tensor::expLorentz(b);
+		TEST_EQ_EPS(B(0,0), cosh(1.5), 1e-12);
+		TEST_EQ_EPS(B(0,1), -sinh(1.5), 1e-12);
+		TEST_EQ_EPS(B(2,2), 1, 1e-12);
+	}
 }
@@ -1,7 +1,314 @@
+#include "Test/Test.h"
 #include "Tensor/Tensor.h"
 #include "Tensor/Derivative.h"
 
 void test_Derivative() {
+	using namespace Tensor;
 
+	// Fornberg stencils
+	{
+		static_assert(PartialDerivativeCoeffs<double, 2>::coeffs[0] == .5);
+		static_assert(CenteredStencil<double, 2, 2>::weights == std::array<double, 3>{1, -2, 1});
+		static_assert(ForwardStencil<double, 1, 2>::weights == std::array<double, 3>{-1.5, 2, -.5});
+		static_assert(BackwardStencil<double, 1, 1>::weights == std::array<double, 2>{-1, 1});
+		static_assert(CenteredStencil<double, 4, 2>::weights == std::array<double, 5>{1, -4, 6, -4, 1});
+		// only the nonzero weights on one side of a centered first derivative are read
+		static_assert(CenteredStencil<double, 1, 4>::numTerms == 2);
 
+		// the old hand-typed tables
+		auto const c8 = PartialDerivativeCoeffs<double, 8>::coeffs;
+		auto const expected8 = std::array<double, 4>{4./5., -1./5., 4./105., -1./280.};
+		for (int i = 0; i < 4; ++i) TEST_EQ_EPS(c8[i], expected8[i], 1e-15);
+		auto const c6 = PartialDerivativeCoeffs<double, 6>::coeffs;
+		auto const expected6 = std::array<double, 3>{3./4., -3./20., 1./60.};
+		for (int i = 0; i < 3; ++i) TEST_EQ_EPS(c6[i], expected6[i], 1e-15);
+
+		// biased: 2nd derivative on offsets -1..2
+		using B = FiniteDifferenceStencil<double, 2, 4, -1>;
+		auto const wb = std::array<double, 4>{1, -2, 1, 0};
+		for (int i = 0; i < 4; ++i) TEST_EQ_EPS(B::weights[i], wb[i], 1e-15);
+
+		// apply() of a 6th order 2nd derivative of x^5 at x=2, exact for polynomials up to degree 7
+		using S = CenteredStencil<double, 2, 6>;
+		auto const h = .125;
+		auto const d2 = S::apply([&](int offset) { auto const x = 2 + offset * h; return x*x*x*x*x; }) / (h * h);
+		TEST_EQ_EPS(d2, 20. * 8., 1e-9);
+
+		// one-sided 3rd derivative, accuracy 1 is exact up to degree 3
+		using F = ForwardStencil<float, 3, 1>;
+		auto const d3 = F::apply([](int offset) { float const x = offset; return x*x*x - x; });
+		TEST_EQ_EPS(d3, 6.f, 1e-5f);
+	}
+
+	// whole-grid partial derivatives
+	{
+		auto const size = int3(8,7,6);
+		auto const dx = double3(.5, .25, 1);
+		auto coord = [&](int3 i) -> double3 { return double3(i(0) * dx(0), i(1) * dx(1), i(2) * dx(2)); };
+
+		// 2nd order is exact for quadratics
+		{
+			auto f = [](double3 x) -> double { return x(0) * x(0) + 3 * x(0) * x(1) - 2 * x(2) * x(2) + x(1); };
+			auto df = [](double3 x) -> double3 { return double3(2 * x(0) + 3 * x(1), 3 * x(0) + 1, -4 * x(2)); };
+			auto g = Grid<double, 3>(size);
+			for (auto i : g.range()) g(i) = f(coord(i));
+			auto dg = partialDerivative<2>(g, dx);
+			TEST_EQ(dg.size, size);
+			// edges use one-sided stencils, also exact for quadratics
+			for (auto i : dg.range()) {
+				for (int k = 0; k < 3; ++k) TEST_EQ_EPS(dg(i)(k), df(coord(i))(k), 1e-12);
+			}
+
+			// a strided view, every other cell along x
+			auto dh = partialDerivative<2>(g.view().strided(int3(2,1,1)), double3(2 * dx(0), dx(1), dx(2)));
+			TEST_EQ(dh.size, int3(4,7,6));
+			TEST_EQ_EPS(dh(1,3,2)(0), df(coord(int3(2,3,2)))(0), 1e-12);
+			TEST_EQ_EPS(dh(2,3,2)(1), df(coord(int3(4,3,2)))(1), 1e-12);
+		}
+
+		// 4th order is exact for quartics, and cells can be tensors
+		{
+			auto f = [](double3 x) -> double2 { return double2(x(0) * x(0) * x(0) + x(1) * x(1) * x(2), x(2) * x(2) * x(2) * x(2)); };
+			auto g = Grid<double2, 3>(size);
+			for (auto i : g.range()) g(i) = f(coord(i));
+			auto dg = partialDerivative<4>(g, dx);
+			auto const i = int3(3,4,2);
+			auto const x = coord(i);
+			TEST_EQ_EPS(dg(i)(0)(0), 3 * x(0) * x(0), 1e-12);
+			TEST_EQ_EPS(dg(i)(1)(0), 2 * x(1) * x(2), 1e-12);
+			TEST_EQ_EPS(dg(i)(2)(0), x(1) * x(1), 1e-12);
+			TEST_EQ_EPS(dg(i)(2)(1), 4 * x(2) * x(2) * x(2), 1e-12);
+			// biased and one-sided at the edges
+			for (auto j : {int3(1,4,2), int3(0,0,0), int3(7,6,5), int3(6,1,4)}) {
+				auto const y = coord(j);
+				TEST_EQ_EPS(dg(j)(0)(0), 3 * y(0) * y(0), 1e-11);
+				TEST_EQ_EPS(dg(j)(1)(0), 2 * y(1) * y(2), 1e-11);
+				TEST_EQ_EPS(dg(j)(2)(1), 4 * y(2) * y(2) * y(2), 1e-11);
+			}
+
+			bool caught = false;
+			try {
+				partialDerivative<4>(Grid<double, 3>(int3(8,4,8)), dx);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+
+		// ghost cells cover the edges
+		{
+			auto g = GhostGrid<double, 3>(size, 1, GridBoundary<double, 3>::extrapolate());
+			for (auto i : g.range()) g(i) = 2 * coord(i)(0) - coord(i)(1) + 3 * coord(i)(2);
+			g.fillGhosts();
+			auto dg = partialDerivative<2>(g, dx);
+			TEST_EQ(dg.size, size);
+			for (auto i : dg.range()) {
+				for (int k = 0; k < 3; ++k) TEST_EQ_EPS(dg(i)(k), double3(2, -1, 3)(k), 1e-12);
+			}
+
+			bool caught = false;
+			try {
+				partialDerivative<4>(g, dx);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+	}
+
+	// second derivatives
+	{
+		// continuous, each sample evaluated once
+		{
+			int numCalls = 0;
+			auto f = [&](double3 x) -> double {
+				++numCalls;
+				return x(0) * x(0) * x(1) + x(1) * x(2) * x(2) * x(2) + x(0) * x(2);
+			};
+			auto const x = double3(1, 2, -1);
+			auto const d2f = secondPartialDerivative<4>(f, x, .125);
+			TEST_EQ(numCalls, 1 + 4 * 3 + 4 * 4 * 3);
+			TEST_EQ_EPS(d2f(0,0), 2 * x(1), 1e-10);
+			TEST_EQ_EPS(d2f(0,1), 2 * x(0), 1e-10);
+			TEST_EQ_EPS(d2f(1,0), 2 * x(0), 1e-10);
+			TEST_EQ_EPS(d2f(0,2), 1., 1e-10);
+			TEST_EQ_EPS(d2f(1,1), 0., 1e-10);
+			TEST_EQ_EPS(d2f(1,2), 3 * x(2) * x(2), 1e-10);
+			TEST_EQ_EPS(d2f(2,2), 6 * x(1) * x(2), 1e-10);
+
+			// tensor valued
+			auto g = [](double2 x) -> double2 { return double2(x(0) * x(0) * x(1), x(1) * x(1)); };
+			auto const d2g = secondPartialDerivative<2>(g, double2(3, 5));
+			TEST_EQ_EPS(d2g(0,0)(0), 10., 1e-6);
+			TEST_EQ_EPS(d2g(0,1)(0), 6., 1e-6);
+			TEST_EQ_EPS(d2g(1,1)(1), 2., 1e-6);
+		}
+
+		// grids, 4th order is exact for quartics, edges included
+		{
+			auto const size = int3(9,7,6);
+			auto const dx = double3(.5, .25, 1);
+			auto coord = [&](int3 i) -> double3 { return double3(i(0) * dx(0), i(1) * dx(1), i(2) * dx(2)); };
+			auto f = [](double3 x) -> double { return x(0) * x(0) * x(1) * x(1) + x(2) * x(2) * x(2) * x(2) - x(0) * x(2); };
+			auto d2f = [](double3 x) -> double3x3 {
+				return double3x3{
+					{2 * x(1) * x(1), 4 * x(0) * x(1), -1},
+					{4 * x(0) * x(1), 2 * x(0) * x(0), 0},
+					{-1, 0, 12 * x(2) * x(2)},
+				};
+			};
+			auto g = Grid<double, 3>(size);
+			for (auto i : g.range()) g(i) = f(coord(i));
+			auto d2g = secondPartialDerivative<4>(g, dx);
+			TEST_EQ(d2g.size, size);
+			for (auto i : d2g.range()) {
+				auto const expected = d2f(coord(i));
+				for (int j = 0; j < 3; ++j) {
+					for (int k = 0; k < 3; ++k) {
+						TEST_EQ_EPS(d2g(i)(j,k), expected(j,k), 1e-9);
+					}
+				}
+			}
+
+			// ghost cells, corners included
+			auto h = GhostGrid<double, 3>(size, 2, GridBoundary<double, 3>::callback([&](int3 i) { return f(coord(i)); }));
+			for (auto i : h.range()) h(i) = f(coord(i));
+			h.fillGhosts();
+			auto d2h = secondPartialDerivative<4>(h, dx);
+			for (auto i : d2h.range()) {
+				auto const expected = d2f(coord(i));
+				for (int j = 0; j < 3; ++j) {
+					for (int k = j; k < 3; ++k) {
+						TEST_EQ_EPS(d2h(i)(j,k), expected(j,k), 1e-9);
+					}
+				}
+			}
+
+			// the one-sided diagonal is one point wider, so it keeps 4th order, exact for quintics
+			auto q = [](double3 x) -> double { return x(0) * x(0) * x(0) * x(0) * x(0) - 2 * x(1) * x(1) * x(1) * x(1) * x(1) + x(0) * x(1) * x(2); };
+			auto d2q = [](double3 x) -> double3x3 {
+				return double3x3{
+					{20 * x(0) * x(0) * x(0), x(2), x(1)},
+					{x(2), -40 * x(1) * x(1) * x(1), x(0)},
+					{x(1), x(0), 0},
+				};
+			};
+			for (auto i : g.range()) g(i) = q(coord(i));
+			auto d2qg = secondPartialDerivative<4>(g, dx);
+			for (auto i : d2qg.range()) {
+				auto const expected = d2q(coord(i));
+				for (int j = 0; j < 3; ++j) {
+					for (int k = j; k < 3; ++k) {
+						TEST_EQ_EPS(d2qg(i)(j,k), expected(j,k), 1e-9);
+					}
+				}
+			}
+
+			// ... which needs one more cell than the centered stencil
+			bool caught = false;
+			try {
+				secondPartialDerivative<4>(Grid<double, 3>(int3(5,6,6)), dx);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+	}
+
+	// covariant derivative
+	{
+		// polar coordinates at r=2: Gamma^r_thth = -r, Gamma^th_rth = 1/r
+		double const r = 2;
+		auto conn = vec<double2s2, 2>();
+		conn(0)(1,1) = -r;
+		conn(1)(0,1) = 1. / r;
+
+		// the metric is covariantly constant
+		auto const g = double2s2{1, 0, r * r};
+		auto dg = vec<double2s2, 2>();
+		dg(0)(1,1) = 2 * r;
+		auto const dgCov = covariantDerivative<'d', 'd'>(g, dg, conn);
+		for (int k = 0; k < 2; ++k) {
+			for (int i = 0; i < 2; ++i) {
+				for (int j = 0; j < 2; ++j) {
+					TEST_EQ_EPS(dgCov(k)(i,j), 0., 1e-15);
+				}
+			}
+		}
+
+		// the constant radial unit vector e_r turns along theta
+		auto const dv = covariantDerivative<'u'>(double2(1, 0), vec<double2, 2>(), conn);
+		TEST_EQ(dv(1), double2(0, 1. / r));
+		TEST_EQ(dv(0), double2(0, 0));
+
+		// scalars
+		TEST_EQ(covariantDerivative<>(3., double2(1, 2), conn), double2(1, 2));
+
+		// mixed valence, against dense sums
+		auto t = double3x3([](int i, int j) -> double { return i - 2 * j + 1; });
+		auto dt = vec<double3x3, 3>([](int k, int i, int j) -> double { return k * i + j; });
+		auto c = vec<double3s3, 3>([](int a, int b, int c) -> double { return a + b * c + .5; });
+		auto const d = covariantDerivative<'u', 'd'>(t, dt, c);
+		for (int k = 0; k < 3; ++k) {
+			for (int i = 0; i < 3; ++i) {
+				for (int j = 0; j < 3; ++j) {
+					double expected = dt(k)(i,j);
+					for (int m = 0; m < 3; ++m) {
+						expected += c(i)(k,m) * t(m,j) - c(m)(k,j) * t(i,m);
+					}
+					TEST_EQ_EPS(d(k)(i,j), expected, 1e-12);
+				}
+			}
+		}
+	}
+
+	// batched, parallel and extrapolated continuous derivatives
+	{
+		auto f = [](double2 x) -> double2 { return double2(std::sin(x(0)) * std::exp(x(1)), x(0) * x(1)); };
+		auto const x = double2(.7, -.3);
+		auto const expected = vec<double2, 2>{
+			{std::cos(x(0)) * std::exp(x(1)), x(1)},
+			{std::sin(x(0)) * std::exp(x(1)), x(0)},
+		};
+		auto const serial = partialDerivativeBatched<4>(batchOf(f), x, .01);
+
+		ThreadPool pool(4);
+		ParallelPolicy policy{ParallelPolicy::Dynamic, 1, &pool};
+		auto const parallel = partialDerivative<4>(f, x, .01, policy);
+		TEST_EQ(serial, parallel);
+		for (int k = 0; k < 2; ++k) {
+			for (int i = 0; i < 2; ++i) {
+				TEST_EQ_EPS(serial(k)(i), expected(k)(i), 1e-8);
+			}
+		}
+
+		// one call of the batched function
+		int numBatches = 0;
+		auto fBatch = [&](std::vector<double2> const & xs) {
+			++numBatches;
+			std::vector<double2> result;
+			for (auto const & xi : xs) result.push_back(f(xi));
+			return result;
+		};
+		auto const batched = partialDerivativeBatched<4>(fBatch, x, .01);
+		TEST_EQ(numBatches, 1);
+		TEST_EQ(batched, serial);
+
+		// Richardson: more accurate from a coarse step, reusing samples between steps
+		int numCalls = 0;
+		auto counted = batchOf([&](double2 xi) { ++numCalls; return f(xi); });
+		auto const r = partialDerivativeRichardson<2>(counted, x, .2, 1e-11);
+		TEST_EQ(r.numEvals, numCalls);
+		TEST_BOOL(r.error < 1e-9);
+		for (int k = 0; k < 2; ++k) {
+			for (int i = 0; i < 2; ++i) {
+				TEST_EQ_EPS(r.value(k)(i), expected(k)(i), 1e-9);
+			}
+		}
+
+		// order 4 samples at step h/2 include those at +-h of step h
+		auto const r4 = partialDerivativeRichardson<4>(batchOf(f), x, .2, 1., 2);
+		TEST_EQ(r4.numLevels, 2);
+		TEST_EQ(r4.numEvals, 4 * 2 + 2 * 2);
+	}
 }
@@ -0,0 +1,60 @@
+#include "Test/Test.h"
+
+void test_Einsum() {
+	using namespace Tensor;
+	Index<'i'> i;
+	Index<'j'> j;
+	Index<'k'> k;
+	Index<'l'> l;
+
+	auto a = double3x4([](int i, int j) -> double { return i + 2 * j + 1; });
+	auto b = double4x2([](int i, int j) -> double { return i * j - 1; });
+	auto c = double2x3([](int i, int j) -> double { return 3 * i - j; });
+	auto v = double4([](int i) -> double { return i + .5; });
+
+	// matrix-matrix
+	auto ab = einsum<double3x2>("ij,jk->ik", a, b);
+	TEST_EQ(ab, a * b);
+	TEST_EQ(ab, einsum<double3x2>(" ij , jk -> ik ", a, b));
+	// transposed result
+	TEST_EQ(einsum<double2x3>("ij,jk->ki", a, b), (a * b).transpose());
+	// implicit result labels are the ones that appear once, in alphabetical order
+	TEST_EQ(einsum<double2x3>("kj,ji", a, b), (a * b).transpose());
+	// matrix-vector
+	TEST_EQ(einsum<double3>("ij,j->i", a, v), a * v);
+	// chains
+	TEST_EQ(einsum<double3x3>("ij,jk,kl->il", a, b, c), (a(i,j) * b(j,k) * c(k,l)).assign(i,l));
+	// outer product
+	TEST_EQ((einsum<tensorx<double, 3, 4, 4>>("ij,k->ijk", a, v)), (a(i,j) * v(k)).assign(i,j,k));
+	// full contraction
+	auto m = double3x3([](int i, int j) -> double { return i * 3 + j; });
+	TEST_EQ(einsum<double>("ii", m), m.trace());
+	TEST_EQ(einsum<double>("ii->", m), m.trace());
+	TEST_EQ(einsum<double>("ij,ij->", m, m), m(i,j) * m(i,j));
+	// diagonal
+	TEST_EQ(einsum<double3>("ii->i", m), double3(0, 4, 8));
+	// sym operands and results
+	auto s = double3s3([](int i, int j) -> double { return i + j + 1; });
+	TEST_EQ(einsum<double3x3>("ij,jk->ik", s, m), s * m);
+	TEST_EQ(einsum<double3s3>("ij,jk,lk->il", m, s, m), (m(i,j) * s(j,k) * m(l,k)).assignR<double3s3>(i,l));
+
+	// held plans skip the lookup
+	auto plan = einsumPlan<double3x2, double3x4, double4x2>("ij,jk->ik");
+	TEST_EQ(plan(a, b), ab);
+
+	// bad specs
+	auto throws = [](auto f) -> bool {
+		try {
+			f();
+		} catch (Common::Exception const &) {
+			return true;
+		}
+		return false;
+	};
+	TEST_BOOL(throws([&]() { einsum<double3x2>("ij->ik", a); }));	// wrong number of operands
+	TEST_BOOL(throws([&]() { einsum<double3x2>("ijk,jk->ik", a, b); }));	// wrong rank
+	TEST_BOOL(throws([&]() { einsum<double3x2>("ij,ik->jk", a, b); }));	// mismatched dims
+	TEST_BOOL(throws([&]() { einsum<double3x2>("ij,jk->il", a, b); }));	// result label not in operands
+	TEST_BOOL(throws([&]() { einsum<double3x3>("ij,jk->ii", a, b); }));	// repeated result label
+	TEST_BOOL(throws([&]() { einsum<double2x3>("ij,jk->ik", a, b); }));	// wrong result dims
+}
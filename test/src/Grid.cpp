@@ -0,0 +1,832 @@
+#include "Test/Test.h"
+#include "Tensor/Grid.h"
+#include "Tensor/Parallel.h"
+#include "Tensor/GridExpr.h"
+#include "Tensor/GridLayout.h"
+#include "Tensor/GridMapping.h"
+#include "Tensor/GridGhost.h"
+#include "Tensor/GridMmap.h"
+#include "Tensor/GridFile.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+void test_Grid() {
+	using namespace Tensor;
+
+	// allocation
+	{
+		auto g = Grid<double, 3>(int3(5,6,7));
+		TEST_EQ((std::uintptr_t)g.v % 64, 0);
+		TEST_BOOL(g.owns());
+		for (auto const & x : g) TEST_EQ(x, 0.);
+
+		auto u = Grid<double, 3>(int3(5,6,7), GridNoInit());
+		TEST_EQ((std::uintptr_t)u.v % 64, 0);
+
+		auto f = Grid<int, 2>(int2(3,4), [](int2 i) -> int { return i(0) + 10 * i(1); });
+		TEST_EQ(f(2,3), 32);
+		auto c = f;
+		TEST_NE(c.v, f.v);
+		TEST_EQ(c(2,3), 32);
+		auto m = f.map<double>([](int x) -> double { return x * .5; });
+		TEST_EQ(m(2,3), 16.);
+	}
+
+	// resize keeps the overlap
+	{
+		auto g = Grid<int, 2>(int2(3,4), [](int2 i) -> int { return i(0) + 10 * i(1); });
+		g.resize(int2(2,5));
+		TEST_EQ(g.size, int2(2,5));
+		TEST_EQ(g.step, int2(1,2));
+		TEST_EQ(g(1,3), 31);
+		TEST_EQ((std::uintptr_t)g.v % 64, 0);
+	}
+
+	// external buffers are not owned
+	{
+		int data[6] = {1,2,3,4,5,6};
+		auto g = Grid<int, 2>(int2(2,3), data);
+		TEST_BOOL(!g.owns());
+		TEST_EQ(g(1,2), 6);
+		g(0,0) = 7;
+		TEST_EQ(data[0], 7);
+	}
+
+	// shared buffers
+	{
+		auto g = Grid<int, 1>(intN<1>(4));
+		auto h = g.share();
+		TEST_EQ(h.v, g.v);
+		TEST_EQ(g.buffer.use_count(), 2);
+		h(2) = 5;
+		TEST_EQ(g(2), 5);
+		{
+			auto moved = std::move(g);
+			TEST_EQ(moved.buffer.use_count(), 2);
+		}
+		TEST_EQ(h.buffer.use_count(), 1);
+		TEST_EQ(h(2), 5);
+	}
+
+	// other allocators
+	{
+		auto g = Grid<double, 2, HugePageAllocator<double>>(int2(512, 1024));
+		TEST_EQ((std::uintptr_t)g.v % HugePageAllocator<double>::hugePageSize, 0);
+		g(511, 1023) = 1;
+		TEST_EQ(g(511, 1023), 1.);
+
+		auto s = Grid<float, 2, std::allocator<float>>(int2(3,3));
+		TEST_EQ(s(2,2), 0.f);
+	}
+
+	// pooled scratch grids reuse their buffers
+	{
+		GridPool pool;
+		using Scratch = Grid<double, 2, GridPoolAllocator<double>>;
+		double * first = {};
+		{
+			auto g = Scratch(int2(16,16), GridNoInit(), GridPoolAllocator<double>(pool));
+			first = g.v;
+		}
+		TEST_EQ(pool.numFree(), 1);
+		{
+			auto g = Scratch(int2(16,16), GridNoInit(), GridPoolAllocator<double>(pool));
+			TEST_EQ(g.v, first);
+			TEST_EQ(pool.numFree(), 0);
+			auto h = Scratch(int2(8,8), GridPoolAllocator<double>(pool));
+			TEST_NE(h.v, first);
+			TEST_EQ(h(7,7), 0.);
+		}
+		TEST_EQ(pool.numFree(), 2);
+		pool.release();
+		TEST_EQ(pool.numFree(), 0);
+	}
+
+	// views
+	{
+		auto g = Grid<int, 3>(int3(4,5,6), [](int3 i) -> int { return i(0) + 10 * i(1) + 100 * i(2); });
+		auto all = g.view();
+		TEST_BOOL(all.isContiguous());
+		TEST_EQ(all(3,4,5), 543);
+
+		// subregion
+		auto s = g.sub(int3(1,2,3), int3(2,2,2));
+		TEST_EQ(s.size, int3(2,2,2));
+		TEST_BOOL(!s.isContiguous());
+		TEST_EQ(s(0,0,0), 321);
+		TEST_EQ(s(1,1,1), 432);
+		s(1,1,1) = -1;
+		TEST_EQ(g(2,3,4), -1);
+		g(2,3,4) = 432;
+		int n = 0;
+		for (auto i : s.range()) {
+			TEST_EQ(s(i), g(i + int3(1,2,3)));
+			++n;
+		}
+		TEST_EQ(n, 8);
+
+		// sub of a sub
+		TEST_EQ(s.sub(int3(1,0,1), int3(1,2,1))(0,1,0), g(2,3,4));
+
+		// strided
+		auto e = g.strided(int3(2,2,2));
+		TEST_EQ(e.size, int3(2,3,3));
+		TEST_EQ(e(1,2,2), g(2,4,4));
+
+		// slices
+		auto xz = g.slice<1>(3);
+		static_assert(std::is_same_v<decltype(xz), GridView<int, 2>>);
+		TEST_EQ(xz.size, int2(4,6));
+		TEST_EQ(xz(2,5), 532);
+		auto z = xz.slice<0>(1);
+		TEST_EQ(z.size, intN<1>(6));
+		TEST_EQ(z(4), 431);
+
+		// const views
+		auto const & cg = g;
+		auto cs = cg.sub(int3(1,1,1), int3(3,4,5));
+		static_assert(std::is_same_v<decltype(cs), GridView<int const, 3>>);
+		GridView<int const, 3> cv = s;
+		TEST_EQ(cv(0,0,0), cs(0,1,2));
+
+		// map and compacting copies
+		auto m = s.map<double>([](int x) -> double { return x * 2; });
+		TEST_EQ(m.size, int3(2,2,2));
+		TEST_EQ(m(1,1,1), 864.);
+		auto c = Grid<int, 3>(e);
+		TEST_EQ(c.size, e.size);
+		TEST_EQ(c(1,2,2), g(2,4,4));
+		TEST_BOOL(c.view().isContiguous());
+
+		// out of bounds
+		bool threw = false;
+		try { g.sub(int3(3,0,0), int3(2,1,1)); } catch (Common::Exception const &) { threw = true; }
+		TEST_BOOL(threw);
+	}
+
+	// bulk copies
+	{
+		auto f = [](int3 i) -> int { return i(0) + 10 * i(1) + 100 * i(2); };
+		auto g = Grid<int, 3>(int3(4,5,6), f);
+
+		// assignment reuses capacity
+		auto h = Grid<int, 3>(int3(8,8,8));
+		int * hv = h.v;
+		h = g;
+		TEST_EQ(h.v, hv);
+		TEST_EQ(h.size, g.size);
+		TEST_EQ(h.step, g.step);
+		for (auto i : h.range()) TEST_EQ(h(i), f(i));
+		// ... but not if it doesn't fit
+		auto small = Grid<int, 3>(int3(1,1,1));
+		small = g;
+		TEST_EQ(small.capacity, 120);
+		TEST_EQ(small(3,4,5), 543);
+
+		// from views, row by row and element by element
+		h.copyFrom(g.sub(int3(1,1,1), int3(2,3,4)));
+		TEST_EQ(h.v, hv);
+		TEST_EQ(h.size, int3(2,3,4));
+		TEST_EQ(h(1,2,3), f(int3(2,3,4)));
+		h.copyFrom(g.strided(int3(2,1,3)));
+		TEST_EQ(h.size, int3(2,5,2));
+		TEST_EQ(h(1,4,1), f(int3(2,4,3)));
+
+		// from a view of itself
+		h = g;
+		h.copyFrom(h.sub(int3(2,2,2), int3(2,3,4)));
+		TEST_EQ(h.size, int3(2,3,4));
+		TEST_EQ(h(0,0,0), f(int3(2,2,2)));
+		TEST_EQ(h(1,2,3), f(int3(3,4,5)));
+
+		// shrinking resize is in place
+		h = g;
+		int * before = h.v;
+		h.resize(int3(3,2,6));
+		TEST_EQ(h.v, before);
+		for (auto i : h.range()) TEST_EQ(h(i), f(i));
+		// growing reallocates
+		h.resize(int3(5,5,5));
+		TEST_NE(h.v, before);
+		for (auto i : RangeObj<3>(int3(), int3(3,2,5))) TEST_EQ(h(i), f(i));
+		// shared buffers aren't resized in place
+		auto k = g;
+		auto ks = k.share();
+		k.resize(int3(2,2,2));
+		TEST_NE(k.v, ks.v);
+		TEST_EQ(ks(3,4,5), 543);
+		TEST_EQ(k(1,1,1), 111);
+
+		// non-trivially copyable types
+		auto strs = Grid<std::string, 2>(int2(3,2), [](int2 i) -> std::string { return std::to_string(i(0)) + std::to_string(i(1)); });
+		auto strs2 = strs;
+		TEST_EQ(strs2(2,1), "21");
+		strs2.resize(int2(2,2));
+		TEST_EQ(strs2(1,1), "11");
+		strs2.copyFrom(strs.sub(int2(1,0), int2(2,2)));
+		TEST_EQ(strs2(1,1), "21");
+	}
+
+	// parallel algorithms
+	{
+		auto f = [](int3 i) -> int { return i(0) + 10 * i(1) + 100 * i(2); };
+		auto const size = int3(37,21,13);
+		auto pool = ThreadPool(4);
+		TEST_EQ(pool.numThreads(), 4);
+
+		for (auto schedule : {ParallelPolicy::Static, ParallelPolicy::Dynamic}) {
+			auto policy = ParallelPolicy{.schedule = schedule, .chunkSize = 100, .pool = &pool};
+			auto g = Grid<int, 3>(size, GridNoInit());
+			parallelFill(g, f, policy);
+			for (auto i : g.range()) TEST_EQ(g(i), f(i));
+
+			// into a view
+			auto h = Grid<int, 3>(size);
+			parallelFill(h.sub(int3(1,2,3), int3(5,5,5)), [](int3) -> int { return 1; }, policy);
+			TEST_EQ(parallelSum(h, policy), 125);
+
+			// into an existing grid
+			parallelTransform(h, g, [](int x) -> int { return 2 * x; }, policy);
+			for (auto i : h.range()) TEST_EQ(h(i), 2 * f(i));
+			// strided, not contiguous
+			auto hs = Grid<int, 3>(int3(19,11,7));
+			parallelTransform(hs, g.strided(int3(2,2,2)), [](int x) -> int { return -x; }, policy);
+			TEST_EQ(hs(18,10,6), -f(int3(36,20,12)));
+		}
+
+		auto g = Grid<int, 3>(size, f);
+		auto d = parallelMap(g, [](int x) -> double { return .5 * x; });
+		static_assert(std::is_same_v<decltype(d), Grid<double, 3>>);
+		TEST_EQ(d(36,20,12), .5 * f(int3(36,20,12)));
+		auto ds = parallelMap(g.slice<2>(4), [](int x) -> double { return x; });
+		TEST_EQ(ds.size, int2(37,21));
+		TEST_EQ(ds(3,4), 443.);
+
+		// reductions
+		long long serialSum = {};
+		for (auto x : g) serialSum += x;
+		TEST_EQ(parallelTransformReduce(g, 0LL, std::plus<long long>(), [](int x) -> long long { return x; }), serialSum);
+		TEST_EQ(parallelSum(g), (int)serialSum);
+		TEST_EQ(parallelMin(g), 0);
+		TEST_EQ(parallelMax(g), f(size - 1));
+		TEST_EQ(parallelMax(g.sub(int3(), int3(2,2,2))), 111);
+		TEST_EQ(parallelSum(Grid<int, 3>()), 0);
+
+		// the same result for any number of threads
+		auto r = Grid<float, 3>(size, [](int3 i) -> float { return 1.f / (1 + i(0) + i(1) * i(2)); });
+		auto const sum1 = parallelSum(r, ParallelPolicy{.pool = &pool});
+		for (int numThreads : {1, 3, 8}) {
+			auto other = ThreadPool(numThreads);
+			TEST_EQ(parallelSum(r, ParallelPolicy{.pool = &other}), sum1);
+		}
+
+		// tensor-valued
+		auto v = Grid<float3, 2>(int2(50,50), [](int2 i) -> float3 { return float3(i(0), i(1), 1); });
+		TEST_EQ(parallelSum(v, ParallelPolicy{.pool = &pool}), float3(61250, 61250, 2500));
+
+		// nested loops run serially within tasks
+		std::atomic<int> count = {};
+		parallelFor(int2(8,8), [&](int2) {
+			parallelFor(int2(4,4), [&](int2) { ++count; }, ParallelPolicy{.pool = &pool});
+		}, ParallelPolicy{.pool = &pool});
+		TEST_EQ(count.load(), 1024);
+
+		// exceptions are rethrown on the calling thread
+		bool caught = false;
+		try {
+			parallelFor(size, [&](int3 i) {
+				if (i == int3(20,10,5)) throw Common::Exception() << "here";
+			}, ParallelPolicy{.schedule = ParallelPolicy::Dynamic, .pool = &pool});
+		} catch (Common::Exception const &) {
+			caught = true;
+		}
+		TEST_BOOL(caught);
+		// and the pool is still usable
+		TEST_EQ(parallelSum(g, ParallelPolicy{.pool = &pool}), (int)serialSum);
+	}
+
+	// expressions
+	{
+		auto const size = int2(17,9);
+		auto a = Grid<double, 2>(size, [](int2 i) -> double { return i(0) + .5 * i(1); });
+		auto b = Grid<double, 2>(size, [](int2 i) -> double { return i(0) * i(1); });
+		auto u = Grid<double, 2>(size, [](int2) -> double { return 1; });
+		double const dt = .25;
+		auto f = [](double x) -> double { return x * x; };
+
+		// lazy until assigned, and assigned in place
+		auto e = u + dt * (gridApply(f, a) - b);
+		static_assert(is_grid_expr_v<decltype(e)>);
+		double * const uv = u.v;
+		u = e;
+		TEST_EQ(u.v, uv);
+		for (auto i : u.range()) TEST_EQ(u(i), 1 + dt * (f(a(i)) - b(i)));
+
+		// constructing
+		Grid<double, 2> w = -a / 2. + 1.;
+		TEST_EQ(w(4,2), -a(4,2) / 2 + 1);
+
+		// parallel gives the same
+		auto up = Grid<double, 2>(size);
+		parallelAssign(up, a * b - a);
+		for (auto i : up.range()) TEST_EQ(up(i), a(i) * b(i) - a(i));
+
+		// non-contiguous operands and destinations
+		auto big = Grid<double, 2>(size * 2, [](int2 i) -> double { return i(0) + 100 * i(1); });
+		u = big.strided(int2(2,2)) + a;
+		TEST_EQ(u(3,4), 6 + 800 + a(3,4));
+		gridAssign(big.sub(int2(1,1), size), a + 1.);
+		TEST_EQ(big(4,2), a(3,1) + 1);
+		TEST_EQ(big(0,0), 0.);
+
+		// destination read at other cells is evaluated through a temporary
+		auto s = Grid<double, 1>(intN<1>(10), [](intN<1> i) -> double { return i(0); });
+		gridAssign(s.sub(intN<1>(0), intN<1>(9)), s.sub(intN<1>(1), intN<1>(9)) * 1.);
+		for (int i = 0; i < 9; ++i) TEST_EQ(s(i), i + 1.);
+
+		// resizes
+		auto r = Grid<double, 2>(int2(2,2));
+		r = a + b;
+		TEST_EQ(r.size, size);
+		TEST_EQ(r(16,8), a(16,8) + b(16,8));
+
+		// mismatched sizes throw
+		bool caught = false;
+		try {
+			u = a + r.sub(int2(), int2(3,3));
+		} catch (Common::Exception const &) {
+			caught = true;
+		}
+		TEST_BOOL(caught);
+
+		// tensor-valued cells use their own operators
+		auto x = Grid<float3, 2>(size, [](int2 i) -> float3 { return float3(i(0), i(1), 0); });
+		auto v = Grid<float3, 2>(size);
+		auto const gravity = float3(0, 0, -9.8f);
+		v = v + .5f * (x + gravity) - gravity * 2.f;
+		TEST_EQ(v(3,4), .5f * (float3(3,4,0) + gravity) - gravity * 2.f);
+		auto dots = Grid<float, 2>(gridApply([](float3 const & p, float3 const & q) -> float { return p.dot(q); }, x, v));
+		TEST_EQ(dots(3,4), x(3,4).dot(v(3,4)));
+
+		auto sy = Grid<float3s3, 2>(size, [](int2 i) -> float3s3 { return float3s3(i(0), i(1), 1, 2, 3, 4); });
+		auto sz = Grid<float3s3, 2>(2.f * sy - sy / 4.f);
+		TEST_EQ(sz(5,6), 1.75f * sy(5,6));
+	}
+
+	// component layouts
+	{
+		auto const size = int3(5,4,3);
+		auto f = [](int3 i) -> double3s3 {
+			double const x = i(0) + 10 * i(1) + 100 * i(2);
+			return double3s3(x, x + .1, x + .2, x + .3, x + .4, x + .5);
+		};
+		auto const aos = Grid<double3s3, 3>(size, f);
+
+		auto testLayout = [&]<typename Layout>(Layout) {
+			auto g = LayoutGrid<double3s3, 3, Layout>(aos);
+			TEST_EQ(g.numComponents, 6);
+			for (auto i : g.range()) TEST_EQ(g(i).get(), f(i));
+			TEST_EQ(g(2,3,1)(0,2), f(int3(2,3,1))(0,2));
+			TEST_EQ(g(2,3,1)(2,0), f(int3(2,3,1))(2,0));
+			auto back = g.toGrid();
+			TEST_BOOL(std::equal(back.begin(), back.end(), aos.begin()));
+
+			// write through the proxy
+			g(1,1,1) = double3s3(1,2,3,4,5,6);
+			TEST_EQ(g(1,1,1).component(3), 4.);
+			g(1,1,1) += double3s3(1,1,1,1,1,1);
+			TEST_EQ((double3s3)g(1,1,1), double3s3(2,3,4,5,6,7));
+			g(1,1,1).component(5) = -1;
+			TEST_EQ(g(1,1,1)(2,2), -1.);
+			g(0,0,0) = g(1,1,1);
+			TEST_EQ(g(0,0,0), double3s3(2,3,4,5,6,-1));
+			TEST_EQ(g(4,3,2), f(int3(4,3,2)));
+
+			auto c = g;
+			TEST_NE(c.v, g.v);
+			TEST_EQ(c(0,0,0), double3s3(2,3,4,5,6,-1));
+			// moved-from is empty, same as Grid
+			auto moved = std::move(c);
+			TEST_EQ(c.v, nullptr);
+			TEST_EQ(c.storedCells, 0);
+			TEST_EQ(moved(0,0,0), double3s3(2,3,4,5,6,-1));
+		};
+		testLayout(GridLayoutAoS());
+		testLayout(GridLayoutSoA());
+		testLayout(GridLayoutAoSoA<8>());
+		testLayout(GridLayoutAoSoA<7>());
+
+		// AoS matches Grid's memory exactly
+		auto ga = LayoutGrid<double3s3, 3, GridLayoutAoS>(aos);
+		TEST_BOOL(std::equal(ga.v, ga.v + 6 * size.product(), &aos.v->s[0]));
+
+		// SoA planes are contiguous
+		auto gs = LayoutGrid<double3s3, 3>(aos);
+		TEST_EQ((std::uintptr_t)gs.v % 64, 0);
+		TEST_EQ(gs.storedCells, 64);
+		for (int c = 0; c < 6; ++c) {
+			auto p = gs.plane(c);
+			TEST_BOOL(p.isContiguous());
+			TEST_EQ((std::uintptr_t)p.v % 64, 0);
+			TEST_EQ(p(3,2,1), 123 + .1 * c);
+		}
+		TEST_EQ(ga.plane(4)(3,2,1), 123.4);
+
+		// AoSoA blocks
+		auto gb = LayoutGrid<double3s3, 3, GridLayoutAoSoA<8>>(aos);
+		TEST_EQ(gb.numBlocks(), 8);
+		// flat cell 13 = (3,2,0), block 1, lane 5
+		TEST_EQ(gb.block(1)[2 * 8 + 5], 23.2);
+
+		// nested storage
+		auto gn = LayoutGrid<tensorx<float, 3, -'a', 3>, 1>(intN<1>(4));
+		TEST_EQ(gn.numComponents, 9);
+		gn(2) = tensorx<float, 3, -'a', 3>([](int i, int j, int k) -> float { return i + j - k; });
+		TEST_EQ(gn(2)(1,0,2), -1.f);
+		TEST_EQ(gn(2)(1,2,0), 1.f);
+	}
+
+	// index mappings
+	{
+		auto const size = int3(7,5,6);
+		auto f = [](int3 i) -> int { return i(0) + 10 * i(1) + 100 * i(2); };
+		auto const src = Grid<int, 3>(size, f);
+
+		auto testMapping = [&]<typename Mapping>(Mapping, int storedCount) {
+			auto g = MappedGrid<int, 3, Mapping>(src);
+			TEST_EQ(g.storedCount, storedCount);
+			for (auto i : g.range()) TEST_EQ(g(i), f(i));
+			// memory order visits every cell once, at increasing addresses
+			int count = 0;
+			int const * last = nullptr;
+			g.forEach([&](int3 const & i, int & x) {
+				TEST_EQ(x, f(i));
+				TEST_BOOL(!last || &x > last);
+				last = &x;
+				++count;
+			});
+			TEST_EQ(count, size.product());
+			// bricks cover every cell once, and are affine
+			int brickCells = 0;
+			g.forEachBrick([&](auto const & b) {
+				for (auto l : RangeObj<3>(int3(), b.extent)) {
+					TEST_EQ(b.offset + l.dot(b.step), g.offset(b.min + l));
+					++brickCells;
+				}
+			});
+			TEST_EQ(brickCells, size.product());
+			// stencil rows read the same neighbors as the tables
+			auto lap = MappedGrid<int, 3, Mapping>(size);
+			int stencilCells = 0;
+			g.template forEachStencilRow<1>([&](int offset, int count, auto const & delta) {
+				for (int k = 0; k < count; ++k) {
+					int const * const x = g.v + offset + k;
+					lap.v[offset + k] = x[delta(0)(0)] + x[delta(0)(2)] + x[delta(1)(0)] + x[delta(1)(2)] + x[delta(2)(0)] + x[delta(2)(2)] - 6 * x[0]
+						+ 1000 * x[delta(0)(2) + delta(1)(0) + delta(2)(2)];
+				}
+				stencilCells += count;
+			});
+			TEST_EQ(stencilCells, (size - 2).product());
+			for (auto i : g.range()) {
+				if (i(0) == 0 || i(1) == 0 || i(2) == 0 || i(0) == size(0) - 1 || i(1) == size(1) - 1 || i(2) == size(2) - 1) {
+					TEST_EQ(lap(i), 0);
+				} else {
+					TEST_EQ(lap(i), g(i - int3(1,0,0)) + g(i + int3(1,0,0)) + g(i - int3(0,1,0)) + g(i + int3(0,1,0)) + g(i - int3(0,0,1)) + g(i + int3(0,0,1)) - 6 * g(i)
+						+ 1000 * g(i + int3(1,-1,1)));
+				}
+			}
+			g(6,4,5) = -1;
+			auto back = g.toGrid();
+			TEST_EQ(back(6,4,5), -1);
+			TEST_EQ(back(1,2,3), 321);
+			auto moved = std::move(g);
+			TEST_EQ(g.v, nullptr);
+			TEST_EQ(g.storedCount, 0);
+			TEST_EQ(moved(6,4,5), -1);
+		};
+		testMapping(GridMappingLinear(), 7*5*6);
+		testMapping(GridMappingTiled<4>(), 8*8*8);
+		testMapping(GridMappingTiled<3>(), 9*6*6);
+		testMapping(GridMappingMorton(), 8*8*8);
+
+		// bricks are contiguous
+		auto t = MappedGrid<int, 3, GridMappingTiled<4>>(size);
+		TEST_EQ(&t(1,0,0) - &t(0,0,0), 1);
+		TEST_EQ(&t(0,1,0) - &t(0,0,0), 4);
+		TEST_EQ(&t(0,0,1) - &t(0,0,0), 16);
+		TEST_EQ(&t(4,0,0) - &t(0,0,0), 64);
+		TEST_EQ(&t(0,4,0) - &t(0,0,0), 128);
+
+		// bits interleaved, skipping dims that run out
+		auto m = MappedGrid<int, 2, GridMappingMorton>(int2(8,2));
+		TEST_EQ(m.storedCount, 16);
+		TEST_EQ(m.offset(int2(1,0)), 1);
+		TEST_EQ(m.offset(int2(0,1)), 2);
+		TEST_EQ(m.offset(int2(2,0)), 4);
+		TEST_EQ(m.offset(int2(4,0)), 8);
+		TEST_EQ(m.offset(int2(7,1)), 15);
+		int next = 0;
+		m.forEach([&](int2 const & i, int &) {
+			TEST_EQ(m.offset(i), next++);
+		});
+
+		// stencil offsets
+		auto const n = t.neighborOffsets<1>(int3(4,3,4));
+		for (auto delta : RangeObj<3>(int3(-1,-1,-1), int3(2,2,2))) {
+			TEST_EQ(n(0)(delta(0)+1) + n(1)(delta(1)+1) + n(2)(delta(2)+1), t.offset(int3(4,3,4) + delta));
+		}
+	}
+
+	// ghost cells
+	{
+		using B = GridBoundary<double, 2>;
+		auto const size = int2(4,3);
+		auto f = [](int2 i) -> double { return 1 + i(0) + 10 * i(1); };
+		auto make = [&](B const & b) {
+			auto g = GhostGrid<double, 2>(size, 2, b);
+			for (auto i : g.range()) g(i) = f(i);
+			g.fillGhosts();
+			return g;
+		};
+		auto wrap = [&](int2 i) -> int2 { return int2((i(0) + 4) % 4, (i(1) + 3) % 3); };
+
+		auto g = make(B::periodic());
+		TEST_EQ(g.grid.size, int2(8,7));
+		TEST_EQ(&g(0,0), &g.grid(2,2));
+		TEST_EQ(g.interior()(3,2), f(int2(3,2)));
+		for (auto i : RangeObj<2>(int2(-2,-2), int2(6,5))) TEST_EQ(g(i), f(wrap(i)));
+
+		g = make(B::mirror());
+		TEST_EQ(g(-1,0), f(int2(0,0)));
+		TEST_EQ(g(-2,0), f(int2(1,0)));
+		TEST_EQ(g(5,1), f(int2(2,1)));
+		TEST_EQ(g(-1,-2), f(int2(0,1)));
+		TEST_EQ(g(4,3), f(int2(3,2)));
+
+		g = make(B::constant(-7));
+		TEST_EQ(g(-1,1), -7.);
+		TEST_EQ(g(5,4), -7.);
+		TEST_EQ(g(3,2), f(int2(3,2)));
+
+		// exact for linear functions, corners included
+		g = make(B::extrapolate());
+		for (auto i : RangeObj<2>(int2(-2,-2), int2(6,5))) TEST_EQ(g(i), f(i));
+
+		g = make(B::callback([&](int2 const & i) -> double { return -f(i); }));
+		TEST_EQ(g(-2,-2), -f(int2(-2,-2)));
+		TEST_EQ(g(1,4), -f(int2(1,4)));
+
+		// per-side, corners take the last dimension's condition
+		auto h = GhostGrid<double, 2>(size, 1);
+		for (auto i : h.range()) h(i) = f(i);
+		h.setBoundary(0, 0, B::periodic());
+		h.setBoundary(0, 1, B::constant(100));
+		h.setBoundary(1, 0, B::mirror());
+		h.setBoundary(1, 1, B::constant(200));
+		h.fillGhosts();
+		TEST_EQ(h(-1,1), f(int2(3,1)));
+		TEST_EQ(h(4,1), 100.);
+		TEST_EQ(h(2,-1), f(int2(2,0)));
+		TEST_EQ(h(2,3), 200.);
+		TEST_EQ(h(-1,-1), f(int2(3,0)));
+		TEST_EQ(h(4,-1), 100.);
+		TEST_EQ(h(-1,3), 200.);
+
+		// tensor-valued, and stencils run over every interior cell without branching
+		auto v = GhostGrid<float3, 1>(intN<1>(8), 1, GridBoundary<float3, 1>::periodic());
+		for (auto i : v.range()) v(i) = float3(i(0), i(0) * i(0), 1);
+		v.fillGhosts();
+		TEST_EQ(v(-1), float3(7, 49, 1));
+		float3 sum;
+		for (auto i : v.range()) sum += v(i(0)+1) - v(i(0)-1);
+		TEST_EQ(sum, float3());
+
+		// too narrow for the ghost width
+		bool caught = false;
+		try {
+			GhostGrid<double, 2>(int2(1,5), 2, B::periodic()).fillGhosts();
+		} catch (Common::Exception const &) {
+			caught = true;
+		}
+		TEST_BOOL(caught);
+
+		// negative ghost widths throw before allocating, whether or not they'd shrink the grid below zero
+		for (int ghost : {-1, -3}) {
+			caught = false;
+			try {
+				GhostGrid<double, 2>(int2(4,5), ghost);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+	}
+
+	// memory-mapped files
+	{
+		auto const filename = (std::filesystem::temp_directory_path() / "test_Grid_mmap.bin").string();
+		auto const size = int3(5,4,3);
+		auto f = [](int3 i) -> double { return i(0) + 10 * i(1) + 100 * i(2); };
+		auto const src = Grid<double, 3>(size, f);
+		{
+			// a header, then the cells
+			std::ofstream o(filename, std::ios::binary);
+			double const header = -1;
+			o.write((char const *)&header, sizeof(header));
+			o.write((char const *)src.v, sizeof(double) * size.product());
+		}
+
+		{
+			auto g = mapGridFile<double, 3>(filename, size, GridMapMode::ReadOnly, sizeof(double), GridMapAdvice::Sequential);
+			TEST_BOOL(g.owns());
+			for (auto i : g.range()) TEST_EQ(g(i), f(i));
+			adviseGrid(g.sub(int3(1,1,1), int3(2,2,2)), GridMapAdvice::Random);
+			// outlives the original
+			auto s = g.share();
+			g = Grid<double, 3>();
+			TEST_EQ(s(4,3,2), 234.);
+			// copies are on the heap
+			auto c = s;
+			c(0,0,0) = 5;
+			TEST_EQ(s(0,0,0), 0.);
+		}
+
+		{
+			auto g = mapGridFile<double, 3>(filename, size, GridMapMode::ReadWrite, sizeof(double));
+			g(1,2,1) = -42;
+			syncGrid(g);
+			// resizing leaves the file alone
+			g.resize(int3(2,2,2));
+			g(1,1,1) = 7;
+		}
+		{
+			auto g = mapGridFile<double, 3>(filename, size, GridMapMode::ReadOnly, sizeof(double));
+			TEST_EQ(g(1,2,1), -42.);
+			TEST_EQ(g(1,1,1), 111.);
+			// a slab of the same file
+			auto slab = mapGridFile<double, 2>(filename, int2(5,4), GridMapMode::ReadOnly, sizeof(double) * (1 + 20 * 2));
+			TEST_EQ(slab(3,1), f(int3(3,1,2)));
+		}
+
+		// too small
+		bool caught = false;
+		try {
+			mapGridFile<double, 3>(filename, int3(5,4,4), GridMapMode::ReadOnly);
+		} catch (Common::Exception const &) {
+			caught = true;
+		}
+		TEST_BOOL(caught);
+
+		{
+			auto g = mapGridFile<float2, 2>(filename, int2(3,3), GridMapMode::Create);
+			for (auto i : g.range()) g(i) = float2(i(0), i(1));
+		}
+		TEST_EQ(std::filesystem::file_size(filename), 9 * sizeof(float2));
+		{
+			auto g = mapGridFile<float2, 2>(filename, int2(3,3));
+			TEST_EQ(g(2,1), float2(2,1));
+			adviseGrid(g, GridMapAdvice::DontNeed);
+			TEST_EQ(g(2,1), float2(2,1));
+		}
+		std::filesystem::remove(filename);
+
+		// DontNeed on the heap keeps the values, of the grid and of whatever shares its first and last pages
+		{
+			auto before = std::vector<double>(100, 3.);
+			auto h = Grid<double, 3>(int3(64,64,4), f);
+			auto after = std::vector<double>(100, 4.);
+			adviseGrid(h, GridMapAdvice::DontNeed);
+			adviseGrid(h.sub(int3(1,1,1), int3(3,60,2)), GridMapAdvice::DontNeed);
+			for (auto i : h.range()) TEST_EQ(h(i), f(i));
+			for (auto x : before) TEST_EQ(x, 3.);
+			for (auto x : after) TEST_EQ(x, 4.);
+		}
+	}
+
+	// chunked grid files
+	{
+		auto const filename = (std::filesystem::temp_directory_path() / "test_GridFile.bin").string();
+		auto f = [](int3 i) -> double { return i(0) + 10 * i(1) + 100 * i(2); };
+		auto const size = int3(7,5,6);
+		auto g = Grid<double, 3>(size);
+		for (auto i : g.range()) g(i) = f(i);
+
+		writeGridFile(filename, g, int3(3,2,4));
+		{
+			auto h = readGridFile<double, 3>(filename);
+			TEST_EQ(h.size, size);
+			TEST_BOOL(std::equal(g.begin(), g.end(), h.begin()));
+
+			// a subregion across chunk boundaries
+			auto r = GridFileReader<double, 3>(filename);
+			TEST_EQ(r.chunkCounts(), int3(3,3,2));
+			auto s = r.read(int3(2,1,3), int3(4,3,2));
+			TEST_EQ(s.size, int3(4,3,2));
+			for (auto i : s.range()) TEST_EQ(s(i), f(i + int3(2,1,3)));
+			// the last, clamped chunk
+			auto c = r.readChunk(int3(2,2,1));
+			TEST_EQ(c.size, int3(1,1,2));
+			TEST_EQ(c(0,0,1), f(int3(6,4,5)));
+			// chunks past the chunk counts
+			for (auto chunk : {int3(3,0,0), int3(0,-1,0), int3(0,0,2)}) {
+				bool caught = false;
+				try {
+					r.readChunk(chunk);
+				} catch (Common::Exception const &) {
+					caught = true;
+				}
+				TEST_BOOL(caught);
+			}
+		}
+
+		// chunk sizes are checked before they are divided by
+		{
+			bool caught = false;
+			try {
+				GridFileWriter<double, 3> w(filename, size, int3(3,0,4));
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+
+		// wrong cell type
+		{
+			bool caught = false;
+			try {
+				GridFileReader<float, 3> r(filename);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+		{
+			bool caught = false;
+			try {
+				GridFileReader<double3, 3> r(filename);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+
+		// a corrupt chunk fails its checksum, other chunks still read
+		{
+			auto const offset = GridFileReader<double, 3>(filename).index[4].offset;
+			std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(offset + 3);
+			file.put((char)0x5a);
+		}
+		{
+			auto r = GridFileReader<double, 3>(filename);
+			bool caught = false;
+			try {
+				r.read(int3(), size);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+			auto s = r.read(int3(0,0,4), int3(3,2,2));
+			TEST_EQ(s(2,1,1), f(int3(2,1,5)));
+		}
+
+		// tensor cells, streamed out of order
+		{
+			using S = sym3<float>;
+			auto const tsize = int2(5,3);
+			auto src = Grid<S, 2>(tsize);
+			for (auto i : src.range()) src(i) = S(i(0), i(1), 1, 2, 3, i(0) * i(1));
+			{
+				auto w = GridFileWriter<S, 2>(filename, tsize, int2(2,2));
+				TEST_EQ(w.header.storage, std::string("s 3"));
+				for (int j = 1; j >= 0; --j) {
+					for (int i = 2; i >= 0; --i) {
+						auto const [min, extent] = w.chunkBox(int2(i,j));
+						w.writeChunk(int2(i,j), src.sub(min, extent));
+					}
+				}
+				bool caught = false;
+				try {
+					w.writeChunk(int2(3,0), src.sub(int2(), int2(1,1)));
+				} catch (Common::Exception const &) {
+					caught = true;
+				}
+				TEST_BOOL(caught);
+				w.close();
+			}
+			auto dst = readGridFile<S, 2>(filename);
+			TEST_BOOL(std::equal(src.begin(), src.end(), dst.begin()));
+
+			bool caught = false;
+			try {
+				readGridFile<float3x3, 2>(filename);
+			} catch (Common::Exception const &) {
+				caught = true;
+			}
+			TEST_BOOL(caught);
+		}
+		std::filesystem::remove(filename);
+	}
+}
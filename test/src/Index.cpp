@@ -476,6 +476,261 @@ void test_Index() {
 		auto c = a(i,j) * b(i,j);
 		TEST_EQ(c, a.interior<2>(b));
 	}
+	{	// fused contraction over multiple indexes, compared to explicit loops
+		Tensor::Index<'i'> i;
+		Tensor::Index<'j'> j;
+		Tensor::Index<'k'> k;
+		Tensor::Index<'l'> l;
+		Tensor::Index<'m'> m;
+		Tensor::Index<'n'> n;
+		auto a = Tensor::tensorr<double, 4, 4>([](Tensor::int4 x) -> double { return x(0) + 2 * x(1) - x(2) + 3 * x(3); });
+		auto b = Tensor::tensorr<double, 4, 4>([](Tensor::int4 x) -> double { return x(0) * x(1) - x(2) + x(3) * x(3); });
+		auto c = (a(i,j,k,l) * b(k,l,m,n)).assignI();
+		static_assert(std::is_same_v<decltype(c), Tensor::tensorr<double, 4, 4>>);
+		for (int i0 = 0; i0 < 4; ++i0) {
+			for (int j0 = 0; j0 < 4; ++j0) {
+				for (int m0 = 0; m0 < 4; ++m0) {
+					for (int n0 = 0; n0 < 4; ++n0) {
+						double sum = 0;
+						for (int k0 = 0; k0 < 4; ++k0) {
+							for (int l0 = 0; l0 < 4; ++l0) {
+								sum += a(i0,j0,k0,l0) * b(k0,l0,m0,n0);
+							}
+						}
+						TEST_EQ(c(i0,j0,m0,n0), sum);
+					}
+				}
+			}
+		}
+		// summed indexes out of order, and a free index interleaved
+		auto d = (a(i,k,j,l) * b(l,m,k,i)).assign(m,j);
+		for (int m0 = 0; m0 < 4; ++m0) {
+			for (int j0 = 0; j0 < 4; ++j0) {
+				double sum = 0;
+				for (int i0 = 0; i0 < 4; ++i0) {
+					for (int k0 = 0; k0 < 4; ++k0) {
+						for (int l0 = 0; l0 < 4; ++l0) {
+							sum += a(i0,k0,j0,l0) * b(l0,m0,k0,i0);
+						}
+					}
+				}
+				TEST_EQ(d(m0,j0), sum);
+			}
+		}
+		// full contraction
+		double e = a(i,j,k,l) * b(i,j,k,l);
+		TEST_EQ(e, a.interior<4>(b));
+	}
+	{	// chained products are collected and contracted in the cheapest order
+		Tensor::Index<'i'> i;
+		Tensor::Index<'j'> j;
+		Tensor::Index<'k'> k;
+		Tensor::Index<'l'> l;
+		auto a = Tensor::double4x4([](int i, int j) -> double { return i + 2 * j; });
+		auto b = Tensor::double4x4([](int i, int j) -> double { return i * j - 1; });
+		auto c = Tensor::double4x4([](int i, int j) -> double { return i - 3 * j; });
+		auto v = Tensor::double4(1,2,3,4);
+		auto e = a(i,j) * b(j,k) * c(k,l) * v(l);
+		static_assert(decltype(e)::contractionCost == 3 * 4 * 4);
+		// right to left: c*v, then b*(cv), then a*(bcv)
+		static_assert(decltype(e)::contractionOrder[0] == std::pair<unsigned, unsigned>{4, 8});
+		static_assert(decltype(e)::contractionOrder[1] == std::pair<unsigned, unsigned>{2, 12});
+		static_assert(decltype(e)::contractionOrder[2] == std::pair<unsigned, unsigned>{1, 14});
+		TEST_EQ(e.contractionOrderString(), "(0*(1*(2*3)))");
+		TEST_EQ(e.assignI(), a * b * c * v);
+		// fully contracted chains
+		double s = v(i) * a(i,j) * b(j,k) * v(k);
+		TEST_EQ(s, dot(v, a * b * v));
+		// an index used a third time is not merged into the chain, it is a new free index
+		auto f = ((a(i,j) * v(j)) * v(j)).assign(i,j);
+		TEST_EQ(f, outer(a * v, v));
+		// products are evaluated upon their first read, so the nodes they hold must outlive the statement that built them
+		auto g = (a(i,j) + b(i,j)) * c(j,k);
+		TEST_EQ(g.assign(i,k), (a + b) * c);
+		auto h = -a(i,j) * v(j);
+		TEST_EQ(h.assign(i), -(a * v));
+	}
+	{	// symmetry is preserved through traces and products
+		Tensor::Index<'i'> i;
+		Tensor::Index<'j'> j;
+		Tensor::Index<'k'> k;
+		auto b = Tensor::symR<double, 3, 4>([](Tensor::int4 x) -> double { return x(0) + x(1) + x(2) + x(3); });
+		auto c = b(i,j,k,k).assignI();
+		static_assert(std::is_same_v<decltype(c), Tensor::double3s3>);
+		TEST_EQ(c, Tensor::double3s3([](int i, int j) -> double { return 3 * (i + j) + 6; }));
+		auto g = Tensor::double3s3([](int i, int j) -> double { return i * j + 1; });
+		auto v = Tensor::double3(1,2,3);
+		auto gv = Tensor::tensori<double, Tensor::storage_sym<3>, Tensor::storage_vec<3>>([&](int i, int j, int k) -> double { return g(i,j) * v(k); });
+		auto d = (gv(i,j,k) * v(k)).assignI();
+		static_assert(std::is_same_v<decltype(d), Tensor::double3s3>);
+		TEST_EQ(d, g * 14.);
+		// transposing a single symmetric storage keeps it
+		static_assert(std::is_same_v<decltype(g(i,j).assign(j,i)), Tensor::double3s3>);
+		// nothing to preserve
+		auto a = Tensor::double3x3([](int i, int j) -> double { return i - 2 * j; });
+		static_assert(std::is_same_v<decltype((a(i,j) * g(j,k)).assignI()), Tensor::double3x3>);
+	}
+	{	// alias analysis
+		Tensor::Index<'i'> i;
+		Tensor::Index<'j'> j;
+		Tensor::Index<'k'> k;
+		auto a = Tensor::double3x3([](int i, int j) -> double { return i + 3 * j; });
+		auto b = Tensor::double3x3([](int i, int j) -> double { return i * j; });
+		// lazy-eval sources may alias, products are cached
+		static_assert(decltype(a(i,j))::mayAlias);
+		static_assert(decltype(a(i,j) + b(j,i))::mayAlias);
+		static_assert(!decltype(a(i,k) * b(k,j))::mayAlias);
+		TEST_BOOL(a(i,j).aliases(&a, &a + 1));
+		TEST_BOOL(!a(i,j).aliases(&b, &b + 1));
+		// non-aliasing writes in place
+		auto c = Tensor::double3x3();
+		c(i,j) = a(j,i) + b(i,j);
+		TEST_EQ(c, a.transpose() + b);
+		// aliasing still reads before writing
+		c = a;
+		c(i,j) = c(j,i) + b(i,j);
+		TEST_EQ(c, a.transpose() + b);
+		// scalars are read before writing too
+		c = a;
+		c(i,j) = b(i,j) * c(0,0);
+		TEST_EQ(c, b * a(0,0));
+		c = a;
+		c(i,j) = c(1,1) - b(i,j);
+		TEST_EQ(c, a(1,1) - b);
+		// aliasing through sub-tensors
+		auto t = Tensor::tensorr<double, 3, 3>([](Tensor::int3 x) -> double { return x(0) + 3 * x(1) + 9 * x(2); });
+		auto t0 = t[0];
+		auto t1 = t[1];
+		TEST_BOOL(t[0](i,j).aliases(&t, &t + 1));
+		TEST_BOOL(!t[0](i,j).aliases(&t[1], &t[1] + 1));
+		t[0](i,j) = t[0](j,i);
+		TEST_EQ(t[0], t0.transpose());
+		t[1](i,j) = t[0](j,i);
+		TEST_EQ(t[1], t0);
+		t = Tensor::tensorr<double, 3, 3>([](Tensor::int3 x) -> double { return x(0) + 3 * x(1) + 9 * x(2); });
+		TEST_EQ(t[1], t1);
+	}
+	{	// trace evaluation policy
+		using namespace Tensor;
+		Index<'i'> i;
+		Index<'j'> j;
+		Index<'k'> k;
+		auto a = tensorr<double, 3, 3>([](int3 x) -> double { return x(0) + 3 * x(1) + 9 * x(2); });
+		auto expected = double3([](int i) -> double { return 9 * i + 30; });
+		// dense result: lazy costs no more than caching
+		static_assert(decltype(a(k,i,k))::useLazyEval);
+		static_assert(decltype(a(k,i,k))::mayAlias);
+		static_assert(!decltype(a.indexEval<IndexEvalCache>(k,i,k))::useLazyEval);
+		static_assert(!decltype(a.indexEval<IndexEvalCache>(k,i,k))::mayAlias);
+		TEST_EQ(a(k,i,k).assign(i), expected);
+		TEST_EQ(a.indexEval<IndexEvalCache>(k,i,k).assign(i), expected);
+		TEST_EQ(a.indexEval<IndexEvalLazy>(k,i,k).assign(i), expected);
+		// lazy traces in expressions, with permuted reads
+		auto b = double3x3([](int i, int j) -> double { return i - 2 * j; });
+		auto q = tensorr<double, 3, 4>([](int4 x) -> double { return x(0) - x(1) + 2 * x(2) * x(3); });
+		static_assert(decltype(q(k,i,k,j) + b(j,i))::mayAlias);
+		TEST_BOOL(q(k,i,k,j).aliases(&q, &q + 1));
+		auto d = (q(k,i,k,j) * 2. + b(j,i)).assign(i,j);
+		auto e = (q.indexEval<IndexEvalCache>(k,i,k,j) * 2. + b(j,i)).assign(i,j);
+		TEST_EQ(d, e);
+		TEST_EQ(d, double3x3([&](int i, int j) -> double { return 2. * (q(0,i,0,j) + q(1,i,1,j) + q(2,i,2,j)) + b(j,i); }));
+		TEST_EQ(q(k,j,k,i).assign(i,j), q.indexEval<IndexEvalCache>(k,j,k,i).assign(i,j));
+		auto f = (a(i,k,k) + a(k,k,i)).assign(i);
+		TEST_EQ(f, (a.indexEval<IndexEvalCache>(i,k,k) + a.indexEval<IndexEvalCache>(k,k,i)).assign(i));
+		// symmetric result with a big enough trace: caching only computes the unique elements
+		auto s = tensori<double, storage_sym<4>, storage_vec<4>, storage_vec<4>>([](int4 x) -> double { return x(0) * x(1) + x(2) - x(3); });
+		static_assert(!decltype(s(i,j,k,k))::useLazyEval);
+		static_assert(std::is_same_v<decltype(s(i,j,k,k).assignI()), double4s4>);
+		static_assert(decltype(s.indexEval<IndexEvalLazy>(i,j,k,k))::useLazyEval);
+		TEST_EQ(s(i,j,k,k).assignI(), s.indexEval<IndexEvalLazy>(i,j,k,k).assignI());
+		TEST_EQ(s(i,j,k,k).assign(j,i), s.indexEval<IndexEvalLazy>(i,j,k,k).assign(j,i));
+	}
+	{	// common subexpressions
+		using namespace Tensor;
+		Index<'i'> i;
+		Index<'j'> j;
+		Index<'k'> k;
+		auto a = double3x3([](int i, int j) -> double { return i + 3 * j; });
+		auto b = double3x3([](int i, int j) -> double { return i * j - 1; });
+		auto ab = a * b;
+		auto p1 = a(i,j) * b(j,k);
+		auto p2 = a(i,j) * b(j,k);
+		auto p3 = a(i,j) * a(j,k);
+		// expression nodes hold their operands by value, so inspect the copies in the tree
+		auto e = p1 + p3 - p2;
+		auto r = e.assign(i,k);
+		TEST_EQ(r, a * a);
+		// same sources and indexes are evaluated once
+		TEST_BOOL(e.a.a.evaluated);
+		TEST_BOOL(!e.b.evaluated);
+		// different sources are not
+		TEST_BOOL(e.a.b.evaluated);
+		// and the sharing ends with the assignment
+		TEST_EQ(e.b.shared, nullptr);
+		TEST_EQ(e.b.assign(i,k), ab);
+		TEST_BOOL(e.b.evaluated);
+		// scalars are compared too
+		double two = 2, three = 3, twoAgain = 2;
+		auto q1 = p1 * two;
+		auto q2 = p1 * three;
+		auto q3 = p2 * twoAgain;
+		TEST_BOOL(!q1.sameExpr(q2));
+		TEST_BOOL(q1.sameExpr(q3));
+		TEST_EQ((q1 + q2 + q3).assign(i,k), ab * 7.);
+		// cached traces are deferred to the first read and shared
+		auto s = tensori<double, storage_sym<4>, storage_vec<4>, storage_vec<4>>([](int4 x) -> double { return x(0) * x(1) + x(2) - x(3); });
+		auto t1 = s(i,j,k,k);
+		static_assert(!decltype(t1)::useLazyEval);
+		TEST_BOOL(!t1.t.evaluated);
+		auto tt = t1 + s(i,j,k,k);
+		auto u = tt.assign(i,j);
+		TEST_BOOL(tt.a.t.evaluated);
+		TEST_BOOL(!tt.b.t.evaluated);
+		TEST_EQ(tt.b.t.shared, nullptr);
+		TEST_EQ(u, s.indexEval<IndexEvalLazy>(i,j,k,k).assign(i,j) * 2.);
+		// in one statement
+		TEST_EQ((a(i,j) * b(j,k) + a(i,j) * b(j,k)).assign(i,k), ab * 2.);
+	}
+	{	// sub-block ranges
+		using namespace Tensor;
+		Index<'i'> i;
+		Index<'j'> j;
+		Index<'k'> k;
+		Index<'i',1> i1;
+		Index<'j',1> j1;
+		Index<'k',1> k1;
+		Index<'i',0,1> i0;
+		Index<'j',1,2> j12;
+		auto g4 = double4x4([](int i, int j) -> double { return 4 * i + j; });
+		auto gamma = double3x3([](int i, int j) -> double { return 4 * (i + 1) + j + 1; });
+		static_assert(std::is_same_v<decltype(g4(i1,j1))::dimseq, std::integer_sequence<int, 3, 3>>);
+		// read
+		auto K = double3x3();
+		K(i,j) = g4(i1,j1);
+		TEST_EQ(K, gamma);
+		TEST_EQ(g4(i1,j1).assign(i,j), gamma);
+		TEST_EQ(g4(j1,i1).assign(i,j), gamma.transpose());
+		TEST_EQ((g4(i0,j12).assign(i,j)), (tensorx<double, 1, 2>{{1, 2}}));
+		// traces
+		TEST_EQ(g4(k1,k1), gamma.trace());
+		auto v = double3([](int i) -> double { return i + 1; });
+		TEST_EQ((g4(i1,k1) * v(k)).assign(i), gamma * v);
+		auto s4 = double4s4([](int i, int j) -> double { return i + j; });
+		auto s3 = double3s3([](int i, int j) -> double { return i + j + 2; });
+		TEST_EQ((s4(i1,j1) + s3(i,j)).assign(i,j), double3x3(s3 * 2.));
+		auto r = tensorr<double, 4, 3>([](int3 x) -> double { return x(0) + 2 * x(1) + 3 * x(2); });
+		TEST_EQ(r(i1,k1,k1).assign(i), double3([&](int i) -> double { return r(i+1,1,1) + r(i+1,2,2) + r(i+1,3,3); }));
+		// write
+		auto h = double4x4();
+		h(i1,j1) = gamma(i,j);
+		TEST_EQ(h, double4x4([&](int i, int j) -> double { return i && j ? gamma(i-1,j-1) : 0.; }));
+		h(i1,j1) = h(j1,i1);	// aliasing
+		TEST_EQ(h, double4x4([&](int i, int j) -> double { return i && j ? gamma(j-1,i-1) : 0.; }));
+		auto hs = double4s4();
+		hs(i1,j1) = s3(i,j);
+		TEST_EQ(hs(2,3), s3(1,2));
+		TEST_EQ(hs(0,3), 0.);
+	}
 
 	//Schwarzschild coordinates
 	{
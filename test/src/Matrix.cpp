@@ -284,4 +284,70 @@ void test_Matrix() {
 
 	// operators
 	operatorScalarTest(m);
+
+	// QR decomposition
+	{
+		auto a = Tensor::double4x3{
+			{2, -1, 3},
+			{1, 4, 0},
+			{-3, 2, 1},
+			{0, 1, -2},
+		};
+		auto const [Q, R] = Tensor::qr(a);
+		static_assert(std::is_same_v<std::decay_t<decltype(Q)>, Tensor::double4x4>);
+		static_assert(std::is_same_v<std::decay_t<decltype(R)>, Tensor::double4x3>);
+		// Q is orthogonal
+		TEST_EQ_EPS(Tensor::normSq(Q * Q.transpose() - Tensor::double4x4(Tensor::ident<double,4>(1))), 0, 1e-20);
+		// R is upper-triangular
+		for (int i = 0; i < 4; ++i) {
+			for (int j = 0; j < i && j < 3; ++j) {
+				TEST_EQ(R(i,j), 0);
+			}
+		}
+		// Q R reconstructs a
+		TEST_EQ_EPS(Tensor::normSq(Q * R - a), 0, 1e-20);
+		// in place gives the same
+		auto b = a;
+		auto const Q2 = Tensor::qrInPlace(b);
+		TEST_EQ(Q2, Q);
+		TEST_EQ(b, R);
+	}
+	{
+		auto a = Tensor::double3x3{
+			{1, 1, 0},
+			{1, 0, 1},
+			{0, 1, 1},
+		};
+		auto const [Q, R] = Tensor::qr(a);
+		TEST_EQ_EPS(Tensor::normSq(Q * R - a), 0, 1e-20);
+		// orthonormal rows, each pointing the same way as its source row, each spanning the same subspace as prior source rows
+		auto o = Tensor::orthonormalize(a);
+		TEST_EQ_EPS(Tensor::normSq(o * o.transpose() - Tensor::double3x3(Tensor::ident<double,3>(1))), 0, 1e-20);
+		for (int i = 0; i < 3; ++i) {
+			TEST_BOOL(Tensor::dot(o[i], a[i]) > 0);
+		}
+		TEST_EQ_EPS(o[0].normSq(), 1, 1e-12);
+		TEST_EQ_EPS(Tensor::normSq(o[0] - a[0].normalize()), 0, 1e-20);
+		TEST_EQ_EPS(Tensor::dot(o[1], a[0]), 0, 1e-12);
+	}
+
+	// matrix exp and log
+	{
+		auto a = Tensor::double3x3{
+			{.1, 2, .3},
+			{-1, .5, .2},
+			{.4, .1, -.3},
+		};
+		auto e = Tensor::exp(a);
+		// compare against a long Taylor series
+		auto taylor = Tensor::double3x3(Tensor::ident<double,3>(1));
+		auto term = taylor;
+		for (int i = 1; i < 40; ++i) {
+			term = term * a / (double)i;
+			taylor += term;
+		}
+		TEST_EQ_EPS(Tensor::normSq(e - taylor), 0, 1e-20);
+		TEST_EQ_EPS(Tensor::normSq(Tensor::log(e) - a), 0, 1e-20);
+		TEST_EQ_EPS(Tensor::normSq(Tensor::exp(Tensor::double3x3()) - Tensor::double3x3(Tensor::ident<double,3>(1))), 0, 1e-20);
+	}
 }
@@ -12,7 +12,9 @@ int main() {
 	test_TotallySymmetric();
 	test_TotallyAntisymmetric();
 	test_Index();
+	test_Einsum();
 	test_Derivative();
+	test_Grid();
 	test_Math();
 	test_Quat();
 	test_Valence();